@@ -1,56 +1,766 @@
 #include "dudero.h"
+#include "dudero_internal.h"
+#include "dudero_fixed.h"
+#include "dudero_bytes.h"
+#include "dudero_pairs.h"
 
 #include <stdint.h>
 #include <stdbool.h>
 
-uint16_t hist[16] = {0}; // count up to 2^16 = 65 536
-size_t hist_samples = 0;
-
 #define MIN_LEN (16)
 
+// backs the legacy (global) stream API
+static dudero_ctx_t stream_ctx;
+
 dudero_ret_t dudero_check_buffer(const uint8_t *buf, size_t len) {
     if (len < MIN_LEN) {
         return DUDERO_RET_TOO_SHORT;
     }
 
-    dudero_stream_init();
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+
+    dudero_ret_t ret = dudero_ctx_add_buf(&ctx, buf, len);
+    if (ret != DUDERO_RET_OK) {
+        return ret;
+    }
+    return dudero_ctx_finish(&ctx);
+}
+
+dudero_ret_t dudero_ctx_init(dudero_ctx_t *ctx) {
+    for (size_t i=0; i<16; i++) {
+        ctx->hist[i] = 0;
+    }
+    ctx->hist_samples = 0;
+    ctx->hist_sumsq = 0;
+    ctx->backend = dudero_backend_best();
+    ctx->tests = DUDERO_TEST_FREQ;
+    ctx->failed = 0;
+    ctx->prev = 0;
+    ctx->have_prev = false;
+    ctx->rct_run = 0;
+    ctx->apt_ref = 0;
+    ctx->apt_pos = 0;
+    ctx->apt_count = 0;
+    ctx->transitions = 0;
+    ctx->fail_fast_len = 0;
+    ctx->thres_q16 = DUDERO_THRES_Q16_DEFAULT;
+    for (size_t i=0; i<8; i++) {
+        ctx->ones[i] = 0;
+    }
+    ctx->alpha_log10 = 0;
+    ctx->bytes = NULL;
+    ctx->pairs = NULL;
+    ctx->stats = NULL;
+    return DUDERO_RET_OK;
+}
+
+static const uint32_t alpha_thres[DUDERO_ALPHA_LOG10_MAX + 1] = {
+    0,
+    DUDERO_THRES_Q16_ALPHA_1, DUDERO_THRES_Q16_ALPHA_2, DUDERO_THRES_Q16_ALPHA_3,
+    DUDERO_THRES_Q16_ALPHA_4, DUDERO_THRES_Q16_ALPHA_5, DUDERO_THRES_Q16_ALPHA_6,
+    DUDERO_THRES_Q16_ALPHA_7, DUDERO_THRES_Q16_ALPHA_8, DUDERO_THRES_Q16_ALPHA_9,
+    DUDERO_THRES_Q16_ALPHA_10, DUDERO_THRES_Q16_ALPHA_11, DUDERO_THRES_Q16_ALPHA_12,
+};
+
+uint32_t dudero_threshold_q16(unsigned alpha_log10) {
+    return (alpha_log10 <= DUDERO_ALPHA_LOG10_MAX) ? alpha_thres[alpha_log10] : 0;
+}
+
+dudero_ret_t dudero_ctx_set_alpha(dudero_ctx_t *ctx, unsigned alpha_log10) {
+    uint32_t thres = dudero_threshold_q16(alpha_log10);
+    if (thres == 0) {
+        return DUDERO_RET_ERROR;
+    }
+    ctx->thres_q16 = thres;
+    ctx->alpha_log10 = (uint8_t)alpha_log10;
+    return DUDERO_RET_OK;
+}
+
+dudero_ret_t dudero_ctx_enable_tests(dudero_ctx_t *ctx, unsigned tests) {
+    if (tests & ~DUDERO_TEST_ALL) {
+        return DUDERO_RET_ERROR;
+    }
+    ctx->tests |= (uint8_t)tests;
+    return DUDERO_RET_OK;
+}
+
+static inline unsigned popcount8(uint8_t x) {
+    x = x - ((x >> 1) & 0x55);
+    x = (x & 0x33) + ((x >> 2) & 0x33);
+    return (x + (x >> 4)) & 0x0F;
+}
+
+// Histogram plus the sequential tests, one byte at a time. State is kept in
+// locals so it stays in registers: the compiler can't prove the hist
+// stores don't alias the ctx fields.
+static void add_fused(dudero_ctx_t *ctx, const uint8_t *buf, size_t len) {
+    const unsigned tests = ctx->tests;
+    unsigned failed = ctx->failed;
+    uint8_t prev = ctx->prev;
+    bool have_prev = ctx->have_prev;
+    uint32_t rct_run = ctx->rct_run;
+    uint8_t apt_ref = ctx->apt_ref;
+    unsigned apt_pos = ctx->apt_pos, apt_count = ctx->apt_count;
+    uint64_t transitions = ctx->transitions;
 
     for (size_t i=0; i<len; i++) {
-        dudero_stream_add(buf[i]);
+        const uint8_t b = buf[i];
+        ctx->hist[b >> 4]++;
+        ctx->hist[b&0x0F]++;
+
+        if (tests & DUDERO_TEST_RCT) {
+            rct_run = (have_prev && b == prev) ? rct_run + 1 : 1;
+            if (rct_run >= DUDERO_RCT_CUTOFF) {
+                failed |= DUDERO_TEST_RCT;
+            }
+        }
+        if (tests & DUDERO_TEST_APT) {
+            if (apt_pos == 0) {
+                apt_ref = b;
+                apt_count = 1;
+            } else if (b == apt_ref && ++apt_count >= DUDERO_APT_CUTOFF) {
+                failed |= DUDERO_TEST_APT;
+            }
+            apt_pos = (apt_pos + 1 == DUDERO_APT_WINDOW) ? 0 : apt_pos + 1;
+        }
+        if (tests & DUDERO_TEST_RUNS) {
+            // flips inside the byte, and from the last bit of the previous one
+            transitions += popcount8((b ^ (b >> 1)) & 0x7F);
+            transitions += have_prev & ((prev ^ (b >> 7)) & 1);
+        }
+        prev = b;
+        have_prev = true;
     }
 
-    return dudero_stream_finish();
+    ctx->failed = (uint8_t)failed;
+    ctx->prev = prev;
+    ctx->have_prev = have_prev;
+    ctx->rct_run = rct_run;
+    ctx->apt_ref = apt_ref;
+    ctx->apt_pos = (uint16_t)apt_pos;
+    ctx->apt_count = (uint16_t)apt_count;
+    ctx->transitions = transitions;
 }
 
-dudero_ret_t dudero_stream_init(void) {
+// Ones per bit position, bit-sliced: (x >> b) & LANES moves bit b of each
+// of the 8 bytes of x into the low bit of its byte, so acc[b] holds 8
+// byte-wide counters of lane b. They're folded every 255 words, before they
+// can wrap. Byte order doesn't matter, the lanes are the same in each byte.
+#define LANES (0x0101010101010101ull)
+#define BITS_FLUSH_WORDS (255)
+
+// sum of the 8 bytes of x
+static inline uint32_t fold_bytes(uint64_t x) {
+    x = (x & 0x00FF00FF00FF00FFull) + ((x >> 8) & 0x00FF00FF00FF00FFull);
+    return (uint32_t)((x * 0x0001000100010001ull) >> 48);
+}
+
+static void bits_add(uint32_t ones[8], const uint8_t *buf, size_t len) {
+    size_t i = 0;
+    while (len - i >= 8) {
+        size_t words = (len - i) / 8;
+        if (words > BITS_FLUSH_WORDS) {
+            words = BITS_FLUSH_WORDS;
+        }
+        uint64_t acc[8] = {0};
+        for (size_t w=0; w<words; w++, i+=8) {
+            // no memcpy, for libc-less builds; compilers turn it into one load
+            const uint8_t *p = buf + i;
+            uint64_t x = (uint64_t)p[0]       | (uint64_t)p[1] << 8  | (uint64_t)p[2] << 16 |
+                         (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+                         (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+            DUDERO_UNROLL
+            for (size_t b=0; b<8; b++) {
+                acc[b] += (x >> b) & LANES;
+            }
+        }
+        for (size_t b=0; b<8; b++) {
+            ones[b] += fold_bytes(acc[b]);
+        }
+    }
+    for (; i<len; i++) {
+        for (size_t b=0; b<8; b++) {
+            ones[b] += (buf[i] >> b) & 1;
+        }
+    }
+}
+
+dudero_ret_t dudero_ctx_set_backend(dudero_ctx_t *ctx, dudero_backend_t backend) {
+    if (!dudero_backend_supported(backend)) {
+        return DUDERO_RET_ERROR;
+    }
+    ctx->backend = backend;
+    return DUDERO_RET_OK;
+}
+
+dudero_ret_t dudero_ctx_set_fail_fast(dudero_ctx_t *ctx, size_t total_len) {
+    if (total_len < MIN_LEN || total_len > DUDERO_MAX_LEN || total_len < ctx->hist_samples/2) {
+        return DUDERO_RET_ERROR;
+    }
+    ctx->fail_fast_len = (uint32_t)total_len;
+    return DUDERO_RET_OK;
+}
+
+// Fail-fast: true if the verdict at fail_fast_len bytes is sure to be bad.
+// Bins can only grow, so the ones already above the final expected count
+// will end at least as far above it: their squared deviations alone are a
+// lower bound of the final cum.
+static bool doomed(const dudero_ctx_t *ctx) {
+    if (ctx->failed) {
+        return true;
+    }
+    uint64_t expected = 2*(uint64_t)ctx->fail_fast_len / 16;
+    uint64_t cum_min = 0;
+    for (size_t i=0; i<16; i++) {
+        if (ctx->hist[i] > expected) {
+            uint64_t delta = ctx->hist[i] - expected;
+            cum_min += delta*delta;
+        }
+    }
+    return dudero_fixed_verdict(cum_min, expected, ctx->thres_q16) == DUDERO_RET_BAD_RANDOMNESS;
+}
+
+// how often fail-fast mode re-evaluates doomed()
+#define FAIL_FAST_BLOCK (256)
+
+static size_t max_len(const dudero_ctx_t *ctx) {
+    return ctx->fail_fast_len ? ctx->fail_fast_len : DUDERO_MAX_LEN;
+}
+
+// tests needing the byte-at-a-time loop
+#define FUSED_TESTS (DUDERO_TEST_RCT | DUDERO_TEST_APT | DUDERO_TEST_RUNS)
+
+// With DUDERO_TEST_BITS, the byte histogram or the transitions a buffer
+// goes through more than one pass, block by block so the later ones read
+// from L1.
+#define L1_BLOCK (16*1024)
+
+// sum h^2 grows by new^2 - old^2 = (new - old) (new + old) per bin, which
+// takes one pass over the bins per block rather than work per byte.
+static void add_block(dudero_ctx_t *ctx, const uint8_t *buf, size_t len) {
+    uint32_t old[16];
     for (size_t i=0; i<16; i++) {
-        hist[i] = 0;
+        old[i] = ctx->hist[i];
+    }
+    if (ctx->tests & FUSED_TESTS) {
+        add_fused(ctx, buf, len);
+    } else {
+        dudero_hist_kernels[ctx->backend](ctx->hist, buf, len);
+    }
+    if (ctx->tests & DUDERO_TEST_BITS) {
+        bits_add(ctx->ones, buf, len);
+    }
+    if (ctx->bytes) {
+        ctx->bytes->add(ctx->bytes->bins, buf, len);
+    }
+    if (ctx->pairs) {
+        ctx->pairs->add(ctx->pairs, buf, len);
+    }
+    for (size_t i=0; i<16; i++) {
+        ctx->hist_sumsq += (uint64_t)(ctx->hist[i] - old[i]) * ((uint64_t)ctx->hist[i] + old[i]);
+    }
+    ctx->hist_samples += 2*(uint64_t)len;
+}
+
+dudero_ret_t dudero_ctx_add(dudero_ctx_t *ctx, uint8_t sample) {
+    if (ctx->hist_samples >= 2*(uint64_t)max_len(ctx)) {
+        return DUDERO_RET_TOO_LONG;
+    }
+    // (h+1)^2 = h^2 + 2h + 1, before each increment
+    ctx->hist_sumsq += 2*(uint64_t)ctx->hist[sample >> 4] + 1;
+    ctx->hist_sumsq += 2*((uint64_t)ctx->hist[sample&0x0F] + ((sample >> 4) == (sample&0x0F))) + 1;
+    if (ctx->tests & FUSED_TESTS) {
+        add_fused(ctx, &sample, 1);
+    } else {
+        ctx->hist[sample >> 4]++;
+        ctx->hist[sample&0x0F]++;
+    }
+    if (ctx->tests & DUDERO_TEST_BITS) {
+        for (size_t b=0; b<8; b++) {
+            ctx->ones[b] += (sample >> b) & 1;
+        }
+    }
+    if (ctx->bytes) {
+        ctx->bytes->bins[sample]++;
+    }
+    if (ctx->pairs) {
+        ctx->pairs->add(ctx->pairs, &sample, 1);
+    }
+    ctx->hist_samples += 2;
+    if (ctx->fail_fast_len && (ctx->failed || ctx->hist_samples % (2*FAIL_FAST_BLOCK) == 0) && doomed(ctx)) {
+        return DUDERO_RET_BAD_RANDOMNESS;
     }
-    hist_samples = 0;
     return DUDERO_RET_OK;
 }
 
-dudero_ret_t dudero_stream_add(uint8_t sample) {
-    hist[sample >> 4]++;
-    hist[sample&0x0F]++;
-    hist_samples += 2; // TODO: check this isn't larger than 2^16
+dudero_ret_t dudero_ctx_add_buf(dudero_ctx_t *ctx, const uint8_t *buf, size_t len) {
+    if (len > max_len(ctx) - ctx->hist_samples/2) {
+        return DUDERO_RET_TOO_LONG;
+    }
+    if (!ctx->fail_fast_len) {
+        size_t block = ((ctx->tests & DUDERO_TEST_BITS) || ctx->bytes || ctx->pairs) ? L1_BLOCK : len;
+        for (size_t off=0; off<len; off+=block) {
+            add_block(ctx, buf + off, (len - off < block) ? len - off : block);
+        }
+        return DUDERO_RET_OK;
+    }
+    for (size_t off=0; off<len; off+=FAIL_FAST_BLOCK) {
+        add_block(ctx, buf + off, (len - off < FAIL_FAST_BLOCK) ? len - off : FAIL_FAST_BLOCK);
+        if (doomed(ctx)) {
+            return DUDERO_RET_BAD_RANDOMNESS;
+        }
+    }
     return DUDERO_RET_OK;
 }
 
-dudero_ret_t dudero_stream_finish(void) {
+dudero_ret_t dudero_ctx_merge(dudero_ctx_t *dst, const dudero_ctx_t *src) {
+    // same limit as dudero_ctx_add_buf()
+    if (src->hist_samples > 2*(uint64_t)max_len(dst) - dst->hist_samples) {
+        return DUDERO_RET_TOO_LONG;
+    }
+    if ((dst->bytes && !src->bytes) || (dst->pairs && !src->pairs)) {
+        return DUDERO_RET_ERROR;
+    }
+    dst->hist_sumsq = 0;
+    for (size_t i=0; i<16; i++) {
+        dst->hist[i] += src->hist[i];
+        dst->hist_sumsq += (uint64_t)dst->hist[i] * dst->hist[i];
+    }
+    if (dst->bytes) {
+        for (size_t v=0; v<256; v++) {
+            dst->bytes->bins[v] += src->bytes->bins[v];
+        }
+    }
+    if (dst->pairs) {
+        for (size_t v=0; v<256; v++) {
+            dst->pairs->cells[v] += src->pairs->cells[v];
+        }
+    }
+    dst->hist_samples += src->hist_samples;
+    dst->failed |= src->failed;
+    dst->transitions += src->transitions;
+    for (size_t b=0; b<8; b++) {
+        dst->ones[b] += src->ones[b];
+    }
+    return DUDERO_RET_OK;
+}
+
+// Verdict on a nibble histogram holding `samples` nibbles. If stat_q16 isn't
+// NULL, also the statistic (saturated to 32 bits).
+static dudero_ret_t evaluate(const uint32_t hist[16], uint64_t samples, uint32_t thres_q16,
+                             uint32_t *stat_q16) {
+    // two samples (nibbles) per byte
+    if (samples < 2*MIN_LEN) {
+        return DUDERO_RET_TOO_SHORT;
+    }
+
     // TODO: handle rounding if len isn't multiple of 8
-    int expected = hist_samples / 16;
-    uint32_t cum = 0;
+    // samples <= 2^31, so every delta^2 and their sum fit in 64 bits
+    uint64_t expected = samples / 16;
+    uint64_t cum = 0;
     for (size_t i=0; i<16; i++) {
-        uint32_t delta = (hist[i] > expected) ? hist[i]-expected : expected-hist[i];
+        uint64_t delta = (hist[i] > expected) ? hist[i]-expected : expected-hist[i];
         cum += delta*delta;
     }
-    double cum_norm = (double)cum / (double)expected;
-    double thres = 45.0;
-  
-    if (cum_norm > thres) {
-        return DUDERO_RET_BAD_RANDOMNESS;
+    if (stat_q16) {
+        // cum < 2^47 keeps the shift in range, see dudero_fixed_verdict()
+        uint64_t stat = (cum < ((uint64_t)1 << 47)) ? (cum << 16) / expected : UINT32_MAX;
+        *stat_q16 = (stat > UINT32_MAX) ? UINT32_MAX : (uint32_t)stat;
+    }
+    return dudero_fixed_verdict(cum, expected, thres_q16);
+}
+
+// Runs test: over n bits, the number of transitions T of a fair coin is
+// Binomial(n-1, 1/2). Fails if |2T - (n-1)| > 5 sqrt(n-1), squared to stay in
+// integers. n <= 2^33, so 25 (n-1) < 2^38: any |d| >= 2^20 fails right away,
+// and smaller ones square without overflow.
+static bool runs_fail(uint64_t transitions, uint64_t bits) {
+    uint64_t flips = bits - 1;
+    uint64_t d = (2*transitions > flips) ? 2*transitions - flips : flips - 2*transitions;
+    if (d >= ((uint64_t)1 << 20)) {
+        return true;
+    }
+    return d*d > 25*flips;
+}
+
+// Same bound as runs_fail() on each lane: n bytes, ones ~ Binomial(n, 1/2).
+// n <= 2^30, so d^2 <= 2^60.
+unsigned dudero_ctx_biased_bits(const dudero_ctx_t *ctx) {
+    uint64_t n = ctx->hist_samples / 2;
+    unsigned lanes = 0;
+    if (!(ctx->tests & DUDERO_TEST_BITS) || n < MIN_LEN) {
+        return 0;
+    }
+    for (size_t b=0; b<8; b++) {
+        uint64_t d = (2*(uint64_t)ctx->ones[b] > n) ? 2*(uint64_t)ctx->ones[b] - n : n - 2*(uint64_t)ctx->ones[b];
+        if (d*d > 25*n) {
+            lanes |= 1u << b;
+        }
+    }
+    return lanes;
+}
+
+static const uint32_t bytes_alpha_thres[DUDERO_ALPHA_LOG10_MAX + 1] = {
+    DUDERO_BYTES_THRES_Q16_DEFAULT,
+    DUDERO_BYTES_THRES_Q16_ALPHA_1, DUDERO_BYTES_THRES_Q16_ALPHA_2, DUDERO_BYTES_THRES_Q16_ALPHA_3,
+    DUDERO_BYTES_THRES_Q16_ALPHA_4, DUDERO_BYTES_THRES_Q16_ALPHA_5, DUDERO_BYTES_THRES_Q16_ALPHA_6,
+    DUDERO_BYTES_THRES_Q16_ALPHA_7, DUDERO_BYTES_THRES_Q16_ALPHA_8, DUDERO_BYTES_THRES_Q16_ALPHA_9,
+    DUDERO_BYTES_THRES_Q16_ALPHA_10, DUDERO_BYTES_THRES_Q16_ALPHA_11, DUDERO_BYTES_THRES_Q16_ALPHA_12,
+};
+
+// Pearson's statistic over the 256 byte bins, exactly: with mu = n/256 and
+// E = floor(mu), sum (h-mu)^2 = sum (h-E)^2 - 256 (mu-E)^2, so
+//   256 sum (h-mu)^2 = 256 sum (h-E)^2 - (n mod 256)^2
+// and the statistic is that over n. Rounding mu down instead would add up
+// to 256/E, a lot next to the threshold at small n. n <= 2^30, so E <= 2^22:
+// a sum of squares past 2^47 fails anyway, and below it 256 times the sum
+// fits in 64 bits.
+static bool bytes_fail(const dudero_ctx_t *ctx) {
+    uint64_t n = ctx->hist_samples / 2;
+    if (ctx->bytes == NULL || n < DUDERO_BYTES_MIN_LEN) {
+        return false;
+    }
+    uint64_t expected = n / 256, r = n % 256;
+    uint64_t cum = 0;
+    for (size_t v=0; v<256; v++) {
+        uint64_t h = ctx->bytes->bins[v];
+        uint64_t delta = (h > expected) ? h-expected : expected-h;
+        cum += delta*delta;
+    }
+    if (cum >= ((uint64_t)1 << 47)) {
+        return true;
+    }
+    return dudero_fixed_verdict(256*cum - r*r, n, bytes_alpha_thres[ctx->alpha_log10]) == DUDERO_RET_BAD_RANDOMNESS;
+}
+
+static const uint32_t pairs_alpha_thres[DUDERO_ALPHA_LOG10_MAX + 1] = {
+    DUDERO_PAIRS_THRES_Q16_DEFAULT,
+    DUDERO_PAIRS_THRES_Q16_ALPHA_1, DUDERO_PAIRS_THRES_Q16_ALPHA_2, DUDERO_PAIRS_THRES_Q16_ALPHA_3,
+    DUDERO_PAIRS_THRES_Q16_ALPHA_4, DUDERO_PAIRS_THRES_Q16_ALPHA_5, DUDERO_PAIRS_THRES_Q16_ALPHA_6,
+    DUDERO_PAIRS_THRES_Q16_ALPHA_7, DUDERO_PAIRS_THRES_Q16_ALPHA_8, DUDERO_PAIRS_THRES_Q16_ALPHA_9,
+    DUDERO_PAIRS_THRES_Q16_ALPHA_10, DUDERO_PAIRS_THRES_Q16_ALPHA_11, DUDERO_PAIRS_THRES_Q16_ALPHA_12,
+};
+
+// Good's serial statistic over the M transitions: with N_ij the cells and
+// r_i their row sums, the pair statistic minus the single nibble one is
+//   (256 sum N_ij^2 - M^2) / M - (16 sum r_i^2 - M^2) / M
+//     = sum_ij (16 N_ij - r_i)^2 / M
+// exactly, in integers, and each row is 16 independent terms, which
+// vectorizes. M is 2n - 1, less one per merge seam. N_ij <= M < 2^31: a
+// |16 N_ij - r_i| of 2^24 or more alone puts the sum past 2^47, which
+// fails anyway, and smaller ones add up without overflow.
+static bool pairs_fail(const dudero_ctx_t *ctx) {
+    uint64_t n = ctx->hist_samples / 2;
+    if (ctx->pairs == NULL || n < DUDERO_PAIRS_MIN_LEN) {
+        return false;
+    }
+    const uint32_t *cells = ctx->pairs->cells;
+    uint64_t cum = 0, m = 0;
+    for (size_t i=0; i<16; i++) {
+        uint64_t r = 0;
+        for (size_t j=0; j<16; j++) {
+            r += cells[16*i + j];
+        }
+        uint64_t over = 0;
+        for (size_t j=0; j<16; j++) {
+            uint64_t c = 16*(uint64_t)cells[16*i + j];
+            uint64_t delta = (c > r) ? c - r : r - c;
+            over |= delta >> 24;
+            cum += delta*delta;
+        }
+        if (over) {
+            return true;
+        }
+        m += r;
+    }
+    return dudero_fixed_verdict(cum, m, pairs_alpha_thres[ctx->alpha_log10]) == DUDERO_RET_BAD_RANDOMNESS;
+}
+
+#if defined(DUDERO_STATS)
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static inline uint64_t ticks(void) {
+    return __builtin_ia32_rdtsc();
+}
+# elif defined(__GNUC__) && defined(__aarch64__)
+static inline uint64_t ticks(void) {
+    uint64_t t;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+}
+# else
+static inline uint64_t ticks(void) {
+    return 0;
+}
+# endif
+
+static void atomic_min(uint32_t *p, uint32_t v) {
+    uint32_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v < cur && !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void atomic_max(uint32_t *p, uint32_t v) {
+    uint32_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void stats_record(dudero_stats_t *s, uint32_t stat, bool bad, uint64_t bytes, uint64_t t) {
+    __atomic_fetch_add(&s->checks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->failures, bad, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->stat_sum, stat, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->ticks, t, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->stat_last, stat, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->ticks_last, (t > UINT32_MAX) ? UINT32_MAX : (uint32_t)t, __ATOMIC_RELAXED);
+    atomic_min(&s->stat_min, stat);
+    atomic_max(&s->stat_max, stat);
+}
+#endif // DUDERO_STATS
+
+void dudero_stats_init(dudero_stats_t *stats) {
+    stats->checks = stats->failures = stats->bytes = stats->stat_sum = stats->ticks = 0;
+    stats->stat_last = stats->stat_max = stats->ticks_last = 0;
+    stats->stat_min = UINT32_MAX;
+}
+
+dudero_ret_t dudero_ctx_attach_stats(dudero_ctx_t *ctx, dudero_stats_t *stats) {
+#if defined(DUDERO_STATS)
+    ctx->stats = stats;
+    return DUDERO_RET_OK;
+#else
+    (void)ctx; (void)stats;
+    return DUDERO_RET_ERROR;
+#endif
+}
+
+void dudero_stats_read(const dudero_stats_t *stats, dudero_stats_t *out) {
+#if defined(DUDERO_STATS)
+    out->checks = __atomic_load_n(&stats->checks, __ATOMIC_RELAXED);
+    out->failures = __atomic_load_n(&stats->failures, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+    out->stat_sum = __atomic_load_n(&stats->stat_sum, __ATOMIC_RELAXED);
+    out->ticks = __atomic_load_n(&stats->ticks, __ATOMIC_RELAXED);
+    out->stat_last = __atomic_load_n(&stats->stat_last, __ATOMIC_RELAXED);
+    out->stat_min = __atomic_load_n(&stats->stat_min, __ATOMIC_RELAXED);
+    out->stat_max = __atomic_load_n(&stats->stat_max, __ATOMIC_RELAXED);
+    out->ticks_last = __atomic_load_n(&stats->ticks_last, __ATOMIC_RELAXED);
+#else
+    *out = *stats;
+#endif
+    if (out->checks == 0) {
+        // not the UINT32_MAX the minimum starts from
+        out->stat_min = 0;
+    }
+}
+
+uint32_t dudero_stats_mean_q16(const dudero_stats_t *stats) {
+    dudero_stats_t s;
+    dudero_stats_read(stats, &s);
+    return s.checks ? (uint32_t)(s.stat_sum / s.checks) : 0;
+}
+
+dudero_ret_t dudero_ctx_finish_tests(const dudero_ctx_t *ctx, unsigned *failed) {
+    unsigned mask = 0;
+    uint32_t *stat = NULL;
+#if defined(DUDERO_STATS)
+    uint64_t t0 = ctx->stats ? ticks() : 0;
+    uint32_t stat_q16 = 0;
+    if (ctx->stats) {
+        stat = &stat_q16;
+    }
+#endif
+    dudero_ret_t ret = evaluate(ctx->hist, ctx->hist_samples, ctx->thres_q16, stat);
+    if (ret == DUDERO_RET_TOO_SHORT) {
+        // not enough data for any test
+        if (failed) {
+            *failed = 0;
+        }
+        return ret;
+    }
+    if (ret == DUDERO_RET_BAD_RANDOMNESS) {
+        mask |= DUDERO_TEST_FREQ;
+    }
+    mask |= ctx->failed;
+    if ((ctx->tests & DUDERO_TEST_RUNS) && runs_fail(ctx->transitions, 4*ctx->hist_samples)) {
+        mask |= DUDERO_TEST_RUNS;
+    }
+    if (dudero_ctx_biased_bits(ctx)) {
+        mask |= DUDERO_TEST_BITS;
+    }
+    if (bytes_fail(ctx)) {
+        mask |= DUDERO_TEST_BYTES;
+    }
+    if (pairs_fail(ctx)) {
+        mask |= DUDERO_TEST_PAIRS;
+    }
+    if (failed) {
+        *failed = mask;
+    }
+#if defined(DUDERO_STATS)
+    if (ctx->stats) {
+        stats_record(ctx->stats, stat_q16, mask != 0, ctx->hist_samples / 2, ticks() - t0);
+    }
+#endif
+    return mask ? DUDERO_RET_BAD_RANDOMNESS : DUDERO_RET_OK;
+}
+
+dudero_ret_t dudero_ctx_finish(const dudero_ctx_t *ctx) {
+    return dudero_ctx_finish_tests(ctx, NULL);
+}
+
+// Same identity as dudero_window_add():
+//   sum (h_i - E)^2 = sum h_i^2 - 2 E sum h_i + 16 E^2
+// samples <= 2^31, so every term fits in 64 bits.
+dudero_ret_t dudero_ctx_peek(const dudero_ctx_t *ctx) {
+    uint64_t samples = ctx->hist_samples;
+    if (samples < 2*MIN_LEN) {
+        return DUDERO_RET_TOO_SHORT;
     }
+    uint64_t expected = samples / 16;
+    uint64_t cum = ctx->hist_sumsq + 16*expected*expected - 2*expected*samples;
+    return dudero_fixed_verdict(cum, expected, ctx->thres_q16);
+}
 
+void dudero_ctx_snapshot(const dudero_ctx_t *ctx, dudero_snapshot_t *snap) {
+    for (size_t i=0; i<16; i++) {
+        snap->hist[i] = ctx->hist[i];
+    }
+    snap->samples = ctx->hist_samples;
+}
+
+dudero_ret_t dudero_snapshot_merge(dudero_snapshot_t *dst, const dudero_snapshot_t *src) {
+    if (src->samples > 2*(uint64_t)DUDERO_MAX_LEN - dst->samples) {
+        return DUDERO_RET_TOO_LONG;
+    }
+    for (size_t i=0; i<16; i++) {
+        dst->hist[i] += src->hist[i];
+    }
+    dst->samples += src->samples;
     return DUDERO_RET_OK;
 }
+
+dudero_ret_t dudero_snapshot_evaluate(const dudero_snapshot_t *snap) {
+    return evaluate(snap->hist, snap->samples, DUDERO_THRES_Q16_DEFAULT, NULL);
+}
+
+static void put_le(uint8_t *out, uint64_t v, size_t bytes) {
+    for (size_t i=0; i<bytes; i++) {
+        out[i] = (uint8_t)(v >> (8*i));
+    }
+}
+
+static uint64_t get_le(const uint8_t *in, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i=0; i<bytes; i++) {
+        v |= (uint64_t)in[i] << (8*i);
+    }
+    return v;
+}
+
+// Wire format, little endian: u64 samples, then u32 hist[0..15].
+void dudero_snapshot_serialize(const dudero_snapshot_t *snap, uint8_t out[DUDERO_SNAPSHOT_SIZE]) {
+    put_le(out, snap->samples, 8);
+    for (size_t i=0; i<16; i++) {
+        put_le(out + 8 + 4*i, snap->hist[i], 4);
+    }
+}
+
+dudero_ret_t dudero_snapshot_deserialize(dudero_snapshot_t *snap, const uint8_t in[DUDERO_SNAPSHOT_SIZE]) {
+    uint64_t samples = get_le(in, 8);
+    uint64_t sum = 0;
+    for (size_t i=0; i<16; i++) {
+        sum += get_le(in + 8 + 4*i, 4);
+    }
+    // every byte is two nibbles, all of them in some bin
+    if (samples != sum || samples % 2 != 0 || samples > 2*(uint64_t)DUDERO_MAX_LEN) {
+        return DUDERO_RET_ERROR;
+    }
+    for (size_t i=0; i<16; i++) {
+        snap->hist[i] = (uint32_t)get_le(in + 8 + 4*i, 4);
+    }
+    snap->samples = samples;
+    return DUDERO_RET_OK;
+}
+
+dudero_ret_t dudero_window_init(dudero_window_t *w, uint8_t *ring, size_t len) {
+    if (ring == NULL || len < MIN_LEN || len > DUDERO_MAX_LEN) {
+        return DUDERO_RET_ERROR;
+    }
+    w->ring = ring;
+    w->len = len;
+    w->pos = 0;
+    w->filled = 0;
+    for (size_t i=0; i<16; i++) {
+        w->hist[i] = 0;
+    }
+    w->sumsq = 0;
+    w->thres_q16 = DUDERO_THRES_Q16_DEFAULT;
+    return DUDERO_RET_OK;
+}
+
+dudero_ret_t dudero_window_set_alpha(dudero_window_t *w, unsigned alpha_log10) {
+    uint32_t thres = dudero_threshold_q16(alpha_log10);
+    if (thres == 0) {
+        return DUDERO_RET_ERROR;
+    }
+    w->thres_q16 = thres;
+    return DUDERO_RET_OK;
+}
+
+// (h+1)^2 - h^2 = 2h + 1
+static inline void window_inc(dudero_window_t *w, uint8_t bin) {
+    w->sumsq += 2*(uint64_t)w->hist[bin] + 1;
+    w->hist[bin]++;
+}
+
+static inline void window_dec(dudero_window_t *w, uint8_t bin) {
+    w->hist[bin]--;
+    w->sumsq -= 2*(uint64_t)w->hist[bin] + 1;
+}
+
+dudero_ret_t dudero_window_add(dudero_window_t *w, uint8_t sample) {
+    if (w->filled == w->len) {
+        uint8_t old = w->ring[w->pos];
+        window_dec(w, old >> 4);
+        window_dec(w, old & 0x0F);
+    } else {
+        w->filled++;
+    }
+    window_inc(w, sample >> 4);
+    window_inc(w, sample & 0x0F);
+    w->ring[w->pos] = sample;
+    w->pos = (w->pos + 1 == w->len) ? 0 : w->pos + 1;
+
+    if (w->filled < w->len) {
+        return DUDERO_RET_TOO_SHORT;
+    }
+    // Same statistic as dudero_ctx_finish, without walking the bins:
+    //   sum (h_i - E)^2 = sum h_i^2 - 2 E sum h_i + 16 E^2
+    // and sum h_i is the number of samples.
+    uint64_t samples = 2*(uint64_t)w->len;
+    uint64_t expected = samples / 16;
+    uint64_t cum = w->sumsq + 16*expected*expected - 2*expected*samples;
+    return dudero_fixed_verdict(cum, expected, w->thres_q16);
+}
+
+dudero_ret_t dudero_stream_init(void) {
+    return dudero_ctx_init(&stream_ctx);
+}
+
+dudero_ret_t dudero_stream_add(uint8_t sample) {
+    return dudero_ctx_add(&stream_ctx, sample);
+}
+
+dudero_ret_t dudero_stream_add_buf(const uint8_t *buf, size_t len) {
+    return dudero_ctx_add_buf(&stream_ctx, buf, len);
+}
+
+dudero_ret_t dudero_stream_finish(void) {
+    return dudero_ctx_finish(&stream_ctx);
+}
+
+dudero_ret_t dudero_stream_peek(void) {
+    return dudero_ctx_peek(&stream_ctx);
+}
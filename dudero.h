@@ -1,5 +1,14 @@
 #pragma once
 
+// Build options (define when compiling the library and its users):
+//
+//   DUDERO_NO_SIMD   only build the portable scalar backend
+//   DUDERO_NO_FLOAT  hide any API taking or returning floating point. The
+//                    checks themselves never use floating point, see
+//                    `make nofloat`.
+//   DUDERO_STATS     compile in the statistics of dudero_ctx_attach_stats().
+//                    Without it the API stays but does nothing, at no cost.
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -10,8 +19,46 @@ typedef enum {
     DUDERO_RET_BAD_RANDOMNESS,
     DUDERO_RET_TOO_SHORT, // passed buffer is too short
     DUDERO_RET_KNOWN_BAD,
+    DUDERO_RET_TOO_LONG, // more than DUDERO_MAX_LEN bytes in one check
 } dudero_ret_t;
 
+// Maximum number of bytes a single check (buffer, or stream between init
+// and finish) can cover: 1 GiB. Keeps every counter and the final
+// statistic well within their integer types.
+#define DUDERO_MAX_LEN ((size_t)1 << 30)
+
+// Thresholds are unsigned Q16.16 fixed point: the value times 2^16.
+#define DUDERO_THRES_Q16(x) ((uint32_t)((x) * 65536u))
+// Threshold used by dudero_check_buffer() and dudero_ctx_finish()
+#define DUDERO_THRES_Q16_DEFAULT DUDERO_THRES_Q16(45)
+
+// On random data the statistic follows a chi-square distribution with 15
+// degrees of freedom, whatever the length. These are its critical values
+// for a false positive rate alpha = 10^-k, in Q16.16: good data fails the
+// check with probability alpha. The default sits at alpha ~= 7.7e-5.
+//
+// The chi-square approximation holds from 5 samples per bin on, i.e.
+// buffers of 40 bytes and more; shorter ones fail a bit more often.
+#define DUDERO_THRES_Q16_ALPHA_1  (1461920u)  // 22.31
+#define DUDERO_THRES_Q16_ALPHA_2  (2003954u)  // 30.58
+#define DUDERO_THRES_Q16_ALPHA_3  (2470530u)  // 37.70
+#define DUDERO_THRES_Q16_ALPHA_4  (2900835u)  // 44.26
+#define DUDERO_THRES_Q16_ALPHA_5  (3309110u)  // 50.49
+#define DUDERO_THRES_Q16_ALPHA_6  (3702354u)  // 56.49
+#define DUDERO_THRES_Q16_ALPHA_7  (4084591u)  // 62.33
+#define DUDERO_THRES_Q16_ALPHA_8  (4458369u)  // 68.03
+#define DUDERO_THRES_Q16_ALPHA_9  (4825416u)  // 73.63
+#define DUDERO_THRES_Q16_ALPHA_10 (5186964u)  // 79.15
+#define DUDERO_THRES_Q16_ALPHA_11 (5543925u)  // 84.59
+#define DUDERO_THRES_Q16_ALPHA_12 (5896994u)  // 89.98
+// For a literal k, e.g. DUDERO_DEFINE_CHECKER(f, 64, DUDERO_THRES_Q16_ALPHA(6))
+#define DUDERO_THRES_Q16_ALPHA(k) DUDERO_THRES_Q16_ALPHA_##k
+#define DUDERO_ALPHA_LOG10_MAX (12)
+
+// Same table at runtime: the threshold for alpha = 10^-alpha_log10, or 0 if
+// alpha_log10 is outside [1, DUDERO_ALPHA_LOG10_MAX].
+uint32_t dudero_threshold_q16(unsigned alpha_log10);
+
 // Checks if the passed buffer "looks random".  Fails if the passed
 // buffer looks like "bad randomness" (obviously biased values, fixed values, etc).
 //
@@ -21,14 +68,241 @@ typedef enum {
 //
 // WARNING: rejecting sequences that fail this test will reduce the source entropy!
 //
+// Safe to call concurrently from several threads: all state lives on the stack.
+//
 dudero_ret_t dudero_check_buffer(const uint8_t *buf, size_t len);
 
+// Implementations of the nibble histogram, the hot loop of
+// dudero_ctx_add_buf(). They all compute exactly the same thing, the scalar
+// one being the reference. Each is compiled for its own instruction set
+// whatever the build flags, so one library binary carries all of them
+// and picks at runtime.
+typedef enum {
+    DUDERO_BACKEND_SCALAR = 0, // portable C, always available
+    DUDERO_BACKEND_SSE2,       // x86
+    DUDERO_BACKEND_AVX2,       // x86
+    DUDERO_BACKEND_NEON,       // AArch64
+    DUDERO_BACKEND_AVX512,     // x86, AVX-512BW
+    DUDERO_BACKEND_COUNT,
+} dudero_backend_t;
+
+// true if the backend is compiled in and the running CPU has the
+// instructions it needs (CPUID on x86, HWCAP on Linux/AArch64)
+bool dudero_backend_supported(dudero_backend_t backend);
+// fastest supported backend, resolved on the first call and cached
+dudero_backend_t dudero_backend_best(void);
+// e.g. "avx2", for logs; "unknown" if out of range
+const char *dudero_backend_name(dudero_backend_t backend);
+
+// Health-check context. Callers allocate it (stack, static, heap...) and
+// own it; the library keeps no hidden state. Distinct contexts can be used
+// concurrently from distinct threads without any locking. Fields are
+// private, go through the dudero_ctx_* functions.
+//
+// If many contexts are updated by different threads, don't pack them
+// into the same cache line (e.g. pad them to 64 bytes) or they'll
+// false-share.
+typedef struct dudero_ctx {
+    uint32_t hist[16];
+    uint64_t hist_samples; // nibbles, i.e. 2 per byte
+    uint64_t hist_sumsq;   // sum of hist[i]^2, for dudero_ctx_peek()
+    uint8_t backend; // dudero_backend_t
+
+    // optional tests, see dudero_ctx_enable_tests()
+    uint8_t tests;   // DUDERO_TEST_* enabled
+    uint8_t failed;  // DUDERO_TEST_* already failed while adding
+    uint8_t prev;    // last byte added, if have_prev
+    bool have_prev;
+    uint32_t rct_run;   // length of the current run of identical bytes
+    uint8_t apt_ref;    // first byte of the current APT window
+    uint16_t apt_pos;   // position in the current APT window
+    uint16_t apt_count; // occurrences of apt_ref in the window so far
+    uint64_t transitions; // bit flips between consecutive bits
+    uint32_t fail_fast_len; // bytes announced by dudero_ctx_set_fail_fast(), 0 if off
+    uint32_t thres_q16; // frequency test threshold
+    uint32_t ones[8];   // set bits per bit position (lane), DUDERO_TEST_BITS
+    uint8_t alpha_log10; // set by dudero_ctx_set_alpha(), 0 for the default
+    struct dudero_bytes *bytes; // see dudero_bytes.h, NULL if not attached
+    struct dudero_pairs *pairs; // see dudero_pairs.h, NULL if not attached
+    struct dudero_stats *stats; // see dudero_ctx_attach_stats(), or NULL
+} dudero_ctx_t;
+
+// Tests a context can run. The nibble frequency test is always on, the
+// others are opt-in. RCT, APT and RUNS run fused in the same pass over the
+// data.
+//
+// RCT, APT: SP800-90B (4.4.1, 4.4.2) repetition count and adaptive
+// proportion tests on bytes. Their cutoffs assume a weak source (at least
+// 4 bits of min-entropy per byte), with false alarm rate 2^-40 per byte.
+// RUNS: total number of runs of identical bits (most significant bit of
+// each byte first), must be within 5 sigma of what a fair coin gives.
+// BITS: for each of the 8 bit positions (lanes), the number of bytes with
+// that bit set, must be within 5 sigma of a fair coin too. Catches a stuck
+// or masked bit, e.g. a bad driver, exactly: from 26 bytes on a stuck lane
+// always fails. Counted 8 bytes at a time, on L1-sized blocks right after
+// the histogram.
+#define DUDERO_TEST_FREQ (1u << 0)
+#define DUDERO_TEST_RCT  (1u << 1)
+#define DUDERO_TEST_APT  (1u << 2)
+#define DUDERO_TEST_RUNS (1u << 3)
+#define DUDERO_TEST_BITS (1u << 4)
+#define DUDERO_TEST_ALL  (DUDERO_TEST_FREQ | DUDERO_TEST_RCT | DUDERO_TEST_APT | DUDERO_TEST_RUNS | \
+                          DUDERO_TEST_BITS)
+// Byte histogram, on with dudero_ctx_attach_bytes() (see dudero_bytes.h)
+// rather than dudero_ctx_enable_tests().
+#define DUDERO_TEST_BYTES (1u << 5)
+// Nibble transitions (serial correlation), on with dudero_ctx_attach_pairs()
+// (see dudero_pairs.h).
+#define DUDERO_TEST_PAIRS (1u << 6)
+
+#define DUDERO_RCT_CUTOFF (11)  // 1 + ceil(40 / 4)
+#define DUDERO_APT_WINDOW (512)
+#define DUDERO_APT_CUTOFF (78)  // 1 + critbinom(512, 2^-4, 1 - 2^-40)
+
+// Also selects dudero_backend_best() for this context.
+dudero_ret_t dudero_ctx_init(dudero_ctx_t *ctx);
+// Overrides the backend picked by dudero_ctx_init(). Returns
+// DUDERO_RET_ERROR (leaving the context untouched) if not supported.
+dudero_ret_t dudero_ctx_set_backend(dudero_ctx_t *ctx, dudero_backend_t backend);
+// Returns DUDERO_RET_TOO_LONG, without adding anything, once the context
+// holds DUDERO_MAX_LEN bytes.
+dudero_ret_t dudero_ctx_add(dudero_ctx_t *ctx, uint8_t sample);
+// Same as calling dudero_ctx_add() on each byte of buf, only much faster.
+// Either adds all of buf or, if that would exceed DUDERO_MAX_LEN, nothing.
+dudero_ret_t dudero_ctx_add_buf(dudero_ctx_t *ctx, const uint8_t *buf, size_t len);
+// Adds everything src has seen to dst, as if its bytes had been added to
+// dst. Order doesn't matter, so a stream can be split into pieces checked
+// by different threads and merged. Failures of the optional tests carry
+// over; bit, runs and pair (dudero_pairs.h) counts add up, minus the one
+// transition across the seam. dst keeps its own backend, alpha and
+// fail-fast settings. DUDERO_RET_TOO_LONG (dst untouched) if the sum would
+// exceed DUDERO_MAX_LEN, or the length announced to dst by
+// dudero_ctx_set_fail_fast(); DUDERO_RET_ERROR (dst untouched) if dst has
+// a dudero_bytes_t or dudero_pairs_t attached and src doesn't.
+dudero_ret_t dudero_ctx_merge(dudero_ctx_t *dst, const dudero_ctx_t *src);
+// Returns DUDERO_RET_TOO_SHORT if fewer than 16 bytes were added.
+// Doesn't modify the context; call dudero_ctx_init() before reusing it.
+dudero_ret_t dudero_ctx_finish(const dudero_ctx_t *ctx);
+// Frequency test verdict on what was added so far, in O(1) from a running
+// sum of squares: same result as the DUDERO_TEST_FREQ part of
+// dudero_ctx_finish_tests(). Doesn't modify the context, so a growing
+// stream can be checked at every checkpoint and keep going.
+dudero_ret_t dudero_ctx_peek(const dudero_ctx_t *ctx);
+
+// Enables the DUDERO_TEST_* in `tests` (FREQ is implied). Call right after
+// dudero_ctx_init(). Enabling RCT, APT or RUNS trades the SIMD histogram
+// for a scalar loop computing everything at once. DUDERO_RET_ERROR on
+// unknown bits.
+dudero_ret_t dudero_ctx_enable_tests(dudero_ctx_t *ctx, unsigned tests);
+// Sets the frequency test's false positive rate to alpha = 10^-alpha_log10
+// (see dudero_threshold_q16()), instead of the default ~7.7e-5. Also
+// applies to the byte histogram and the transitions, if attached.
+// DUDERO_RET_ERROR, leaving the context untouched, if out of range.
+dudero_ret_t dudero_ctx_set_alpha(dudero_ctx_t *ctx, unsigned alpha_log10);
+// Lanes failing DUDERO_TEST_BITS: bit b set if bit position b (1 << b in
+// each byte) is biased. 0 if the test isn't enabled or too few bytes.
+unsigned dudero_ctx_biased_bits(const dudero_ctx_t *ctx);
+// Fail-fast mode, for callers that bail out on bad randomness anyway (e.g.
+// to switch to another source at boot). The caller announces how many
+// bytes it'll add in total before dudero_ctx_finish(); adding more is
+// DUDERO_RET_TOO_LONG. From then on dudero_ctx_add() and
+// dudero_ctx_add_buf() return DUDERO_RET_BAD_RANDOMNESS as soon as the
+// final verdict is sure to be bad (or RCT/APT, if enabled, tripped).
+// dudero_ctx_add_buf() then stops early, so a dead source is rejected
+// after a fraction of the input rather than at the end. Never rejects data
+// that would pass.
+//
+// DUDERO_RET_ERROR if total_len is out of [16, DUDERO_MAX_LEN] or below
+// what was already added.
+dudero_ret_t dudero_ctx_set_fail_fast(dudero_ctx_t *ctx, size_t total_len);
+// Same as dudero_ctx_finish(), also reporting in *failed (if not NULL)
+// which DUDERO_TEST_* failed; 0 if none.
+dudero_ret_t dudero_ctx_finish_tests(const dudero_ctx_t *ctx, unsigned *failed);
+
+// Snapshot of a context's histogram, e.g. for shipping it to an
+// aggregator instead of the raw bytes: snapshots from many contexts
+// (nodes, threads...) merge into one verdict over all of their data.
+typedef struct dudero_snapshot {
+    uint32_t hist[16];
+    uint64_t samples; // nibbles, i.e. 2 per byte
+} dudero_snapshot_t;
+
+// serialized size, independent of host endianness and padding
+#define DUDERO_SNAPSHOT_SIZE (72)
+
+void dudero_ctx_snapshot(const dudero_ctx_t *ctx, dudero_snapshot_t *snap);
+// Same as dudero_ctx_merge(), on snapshots.
+dudero_ret_t dudero_snapshot_merge(dudero_snapshot_t *dst, const dudero_snapshot_t *src);
+// Same verdict dudero_ctx_finish() gives on a context holding that data.
+dudero_ret_t dudero_snapshot_evaluate(const dudero_snapshot_t *snap);
+void dudero_snapshot_serialize(const dudero_snapshot_t *snap, uint8_t out[DUDERO_SNAPSHOT_SIZE]);
+// DUDERO_RET_ERROR (snap untouched) if `in` isn't a consistent snapshot.
+dudero_ret_t dudero_snapshot_deserialize(dudero_snapshot_t *snap, const uint8_t in[DUDERO_SNAPSHOT_SIZE]);
+
+// Sliding-window (continuous) health test: after every byte, a verdict on
+// the last `len` bytes seen. Same statistic as dudero_ctx_finish(), but
+// updated incrementally, so each dudero_window_add() is O(1).
+//
+// The caller provides the ring buffer holding the window, `len` bytes
+// that must outlive the dudero_window_t. Fields are private.
+typedef struct dudero_window {
+    uint8_t *ring;
+    size_t len;
+    size_t pos;    // next slot of ring to overwrite
+    size_t filled; // bytes in the window, up to len
+    uint32_t hist[16];
+    uint64_t sumsq; // sum of hist[i]^2
+    uint32_t thres_q16;
+} dudero_window_t;
+
+// len must be between 16 and DUDERO_MAX_LEN, else DUDERO_RET_ERROR.
+dudero_ret_t dudero_window_init(dudero_window_t *w, uint8_t *ring, size_t len);
+// Slides the window one byte and returns the verdict over it, or
+// DUDERO_RET_TOO_SHORT until the first `len` bytes have been added.
+dudero_ret_t dudero_window_add(dudero_window_t *w, uint8_t sample);
+// Same as dudero_ctx_set_alpha(), for the window verdicts.
+dudero_ret_t dudero_window_set_alpha(dudero_window_t *w, unsigned alpha_log10);
+
+// Statistics over many checks, for trends and drift rather than pass/fail.
+// Attach the same dudero_stats_t to each context (contexts are re-inited
+// per check, the stats aren't) and every dudero_ctx_finish() or
+// dudero_ctx_finish_tests() with enough data records into it: statistic
+// (cum / expected, in Q16.16, saturating), verdict, bytes and, where a
+// cycle counter is available (x86 TSC, AArch64 virtual counter), the ticks
+// spent in the finish call.
+//
+// Updates are relaxed atomics, so several threads can record into, and
+// others read from, the same stats without locks. Each field is consistent
+// on its own; read them through dudero_stats_read(). Only with DUDERO_STATS.
+typedef struct dudero_stats {
+    uint64_t checks;
+    uint64_t failures;
+    uint64_t bytes;
+    uint64_t stat_sum;    // of stat_last over all checks, for the mean
+    uint64_t ticks;       // total spent in finish, 0 without a counter
+    uint32_t stat_last;   // Q16.16
+    uint32_t stat_min;    // UINT32_MAX until the first check, read as 0
+    uint32_t stat_max;
+    uint32_t ticks_last;
+} dudero_stats_t;
+
+void dudero_stats_init(dudero_stats_t *stats);
+// DUDERO_RET_ERROR if the library was built without DUDERO_STATS.
+dudero_ret_t dudero_ctx_attach_stats(dudero_ctx_t *ctx, dudero_stats_t *stats);
+// Lock-free copy of stats into out; stat_min is 0 before the first check.
+void dudero_stats_read(const dudero_stats_t *stats, dudero_stats_t *out);
+// stat_sum / checks, in Q16.16; 0 before the first check.
+uint32_t dudero_stats_mean_q16(const dudero_stats_t *stats);
+
+// Legacy stream API: same as the dudero_ctx_* functions above, operating
+// on a single context global to the library.
+//
 // you need to use either the buffer OR the stream API,
 // mixing them is bad
 //
-// nothing of this is thread safe
-//
-// TODO: this is screaming passing a ctx
+// nothing of this is thread safe: use a dudero_ctx_t per thread instead
 dudero_ret_t dudero_stream_init(void);
 dudero_ret_t dudero_stream_add(uint8_t sample);
+dudero_ret_t dudero_stream_add_buf(const uint8_t *buf, size_t len);
 dudero_ret_t dudero_stream_finish(void);
+dudero_ret_t dudero_stream_peek(void);
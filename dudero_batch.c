@@ -0,0 +1,184 @@
+#include "dudero_batch.h"
+#include "dudero_internal.h"
+
+#include <string.h>
+
+#if !defined(DUDERO_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define DUDERO_HAVE_X86 1
+# include <immintrin.h>
+#endif
+
+#define LANES DUDERO_BATCH_LANES
+
+// Bins are at most 2 * (DUDERO_BATCH_MAX_LEN + 15) < 2^16, so 16 bits per
+// counter are enough, and cum, a sum of 16 squares below 2^26, fits in 32.
+typedef uint16_t lane_hist_t[16][LANES];
+
+// cnt[v][j] += nibbles of value v in ptr[j][0..len[j]), for the first n lanes.
+static void count_lanes_scalar(lane_hist_t cnt, const uint8_t *const ptr[LANES], const size_t len[LANES],
+                               size_t n) {
+    size_t minlen = len[0], maxlen = 0;
+    for (size_t j=0; j<n; j++) {
+        minlen = (len[j] < minlen) ? len[j] : minlen;
+        maxlen = (len[j] > maxlen) ? len[j] : maxlen;
+    }
+    // position by position: consecutive increments hit different lanes, so
+    // they don't wait on each other even if the bytes are equal
+    for (size_t p=0; p<minlen; p++) {
+        for (size_t j=0; j<n; j++) {
+            const uint8_t b = ptr[j][p];
+            cnt[b >> 4][j]++;
+            cnt[b&0x0F][j]++;
+        }
+    }
+    for (size_t p=minlen; p<maxlen; p++) {
+        for (size_t j=0; j<n; j++) {
+            if (p < len[j]) {
+                const uint8_t b = ptr[j][p];
+                cnt[b >> 4][j]++;
+                cnt[b&0x0F][j]++;
+            }
+        }
+    }
+}
+
+#if defined(DUDERO_HAVE_X86)
+// Same, for all lanes (unused ones have len 0). Same scheme as the hist
+// kernels (see dudero_hist.c), one buffer per byte lane: 16 bytes of each
+// of the 16 buffers are transposed so each vector holds one position of
+// every buffer. Four rounds of unpacking rows i and i+8 transpose, with
+// lanes in bit-reversed order.
+static const uint8_t lane_of[LANES] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+
+// 8-bit counters grow by 2 per position: flush every 7 blocks of 16
+#define FLUSH_BLOCKS (7)
+
+__attribute__((target("sse2")))
+static void count_lanes_sse2(lane_hist_t cnt, const uint8_t *const ptr[LANES], const size_t len[LANES]) {
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t maxlen = 0;
+    for (size_t j=0; j<LANES; j++) {
+        maxlen = (len[j] > maxlen) ? len[j] : maxlen;
+    }
+    __m128i acc[16];
+    for (int v=0; v<16; v++) {
+        acc[v] = _mm_setzero_si128();
+    }
+    size_t blocks = 0;
+    for (size_t p=0; p<maxlen; p+=16) {
+        // Past its end a buffer reads as zeros, counted in bin 0 and taken
+        // back out below.
+        __m128i x[LANES], y[LANES];
+        for (size_t j=0; j<LANES; j++) {
+            if (len[j] >= p + 16) {
+                x[j] = _mm_loadu_si128((const __m128i *)(ptr[j] + p));
+            } else {
+                uint8_t tail[16] = {0};
+                if (len[j] > p) {
+                    memcpy(tail, ptr[j] + p, len[j] - p);
+                }
+                x[j] = _mm_loadu_si128((const __m128i *)tail);
+            }
+        }
+        for (size_t i=0; i<8; i++) {
+            y[2*i] = _mm_unpacklo_epi8(x[i], x[i+8]);
+            y[2*i+1] = _mm_unpackhi_epi8(x[i], x[i+8]);
+        }
+        for (size_t i=0; i<8; i++) {
+            x[2*i] = _mm_unpacklo_epi16(y[i], y[i+8]);
+            x[2*i+1] = _mm_unpackhi_epi16(y[i], y[i+8]);
+        }
+        for (size_t i=0; i<8; i++) {
+            y[2*i] = _mm_unpacklo_epi32(x[i], x[i+8]);
+            y[2*i+1] = _mm_unpackhi_epi32(x[i], x[i+8]);
+        }
+        for (size_t i=0; i<8; i++) {
+            x[2*i] = _mm_unpacklo_epi64(y[i], y[i+8]);
+            x[2*i+1] = _mm_unpackhi_epi64(y[i], y[i+8]);
+        }
+        for (size_t q=0; q<16; q++) {
+            __m128i lo = _mm_and_si128(x[q], mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(x[q], 4), mask);
+            DUDERO_UNROLL
+            for (int v=0; v<16; v++) {
+                __m128i nib = _mm_set1_epi8((char)v);
+                acc[v] = _mm_sub_epi8(acc[v], _mm_add_epi8(_mm_cmpeq_epi8(lo, nib), _mm_cmpeq_epi8(hi, nib)));
+            }
+        }
+        if (++blocks % FLUSH_BLOCKS == 0 || p + 16 >= maxlen) {
+            for (int v=0; v<16; v++) {
+                uint8_t c[16];
+                _mm_storeu_si128((__m128i *)c, acc[v]);
+                for (size_t e=0; e<16; e++) {
+                    cnt[v][lane_of[e]] += c[e];
+                }
+                acc[v] = _mm_setzero_si128();
+            }
+        }
+    }
+    for (size_t j=0; j<LANES; j++) {
+        cnt[0][j] -= (uint16_t)(2*(16*blocks - len[j]));
+    }
+}
+#endif // DUDERO_HAVE_X86
+
+// Checks the n <= LANES buffers at bufs[idx[0..n)].
+static void check_lanes(const uint8_t *const *bufs, const size_t *lens, const size_t *idx, size_t n,
+                        dudero_ret_t *out) {
+    lane_hist_t cnt;
+    const uint8_t *ptr[LANES];
+    size_t len[LANES];
+
+    memset(cnt, 0, sizeof cnt);
+    for (size_t j=0; j<LANES; j++) {
+        len[j] = (j < n) ? lens[idx[j]] : 0;
+        ptr[j] = (j < n) ? bufs[idx[j]] : NULL;
+    }
+#if defined(DUDERO_HAVE_X86)
+    if (dudero_backend_supported(DUDERO_BACKEND_SSE2)) {
+        count_lanes_sse2(cnt, ptr, len);
+    } else
+#endif
+    {
+        count_lanes_scalar(cnt, ptr, len, n);
+    }
+
+    // Same verdict as dudero_fixed_verdict(), cum << 16 > thres * expected,
+    // as cum > floor(thres * expected / 2^16) to stay in 32 bits. Every
+    // lane at once; unused ones compute garbage nobody reads.
+    uint32_t expected[LANES], limit[LANES], cum[LANES];
+    for (size_t j=0; j<LANES; j++) {
+        expected[j] = (uint32_t)(2*len[j] / 16);
+        limit[j] = (uint32_t)(((uint64_t)DUDERO_THRES_Q16_DEFAULT * expected[j]) >> 16);
+        cum[j] = 0;
+    }
+    for (size_t v=0; v<16; v++) {
+        for (size_t j=0; j<LANES; j++) {
+            uint32_t c = cnt[v][j], e = expected[j];
+            uint32_t delta = (c > e) ? c - e : e - c;
+            cum[j] += delta*delta;
+        }
+    }
+    for (size_t j=0; j<n; j++) {
+        out[idx[j]] = (cum[j] > limit[j]) ? DUDERO_RET_BAD_RANDOMNESS : DUDERO_RET_OK;
+    }
+}
+
+void dudero_check_buffers(const uint8_t *const *bufs, const size_t *lens, size_t k, dudero_ret_t *out) {
+    size_t idx[LANES];
+    size_t n = 0;
+    for (size_t i=0; i<k; i++) {
+        if (lens[i] < 16 || lens[i] > DUDERO_BATCH_MAX_LEN) {
+            out[i] = dudero_check_buffer(bufs[i], lens[i]);
+            continue;
+        }
+        idx[n++] = i;
+        if (n == LANES) {
+            check_lanes(bufs, lens, idx, n, out);
+            n = 0;
+        }
+    }
+    if (n) {
+        check_lanes(bufs, lens, idx, n, out);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Batch check of many small buffers (keys, nonces, ...) in one call. With
+// a buffer of 32 bytes a single dudero_check_buffer() spends most of its
+// time setting up and finishing a context; here that cost is shared.
+//
+// Buffers go through in groups of DUDERO_BATCH_LANES, each one counted in
+// its own column of a nibble-by-lane table: consecutive increments go to
+// different counters, so they don't wait on each other, and the final
+// statistic and verdict run across all lanes at once. On x86 the counting
+// compares 16 buffers per SSE2 instruction; elsewhere it's scalar.
+
+#include "dudero.h"
+
+#define DUDERO_BATCH_LANES (16)
+// Longer buffers are checked one by one with dudero_check_buffer(), whose
+// kernels are faster once the fixed cost doesn't matter.
+#define DUDERO_BATCH_MAX_LEN (256)
+
+// Sets out[i] to exactly what dudero_check_buffer(bufs[i], lens[i]) returns,
+// for i in [0, k).
+void dudero_check_buffers(const uint8_t *const *bufs, const size_t *lens, size_t k, dudero_ret_t *out);
@@ -0,0 +1,52 @@
+// Byte histogram kernel. Counting bytes into a single table stalls on runs
+// of equal bytes: each increment has to wait for the previous store to the
+// same counter. Four tables, one per byte position mod 4, break the chain,
+// and are summed at the end. The tables are 16-bit, so they fit in L1 next
+// to the data, and are folded into the 32-bit bins before they can wrap.
+
+#include "dudero_bytes.h"
+
+#define WAYS (4)
+// bytes per fold: up to 65535 increments per 16-bit counter
+#define FOLD_LEN ((size_t)WAYS * 65535)
+// below this, zeroing and folding the tables costs more than it saves
+#define INTERLEAVE_MIN_LEN (1024)
+
+static void bytes_add(uint32_t bins[256], const uint8_t *buf, size_t len) {
+    size_t i = 0;
+    while (len - i >= INTERLEAVE_MIN_LEN) {
+        size_t n = (len - i) / WAYS * WAYS;
+        if (n > FOLD_LEN) {
+            n = FOLD_LEN;
+        }
+        uint16_t t[WAYS][256];
+        for (size_t v=0; v<256; v++) {
+            t[0][v] = t[1][v] = t[2][v] = t[3][v] = 0;
+        }
+        for (const uint8_t *p = buf + i, *end = buf + i + n; p < end; p += WAYS) {
+            t[0][p[0]]++;
+            t[1][p[1]]++;
+            t[2][p[2]]++;
+            t[3][p[3]]++;
+        }
+        for (size_t v=0; v<256; v++) {
+            bins[v] += (uint32_t)t[0][v] + t[1][v] + t[2][v] + t[3][v];
+        }
+        i += n;
+    }
+    for (; i<len; i++) {
+        bins[buf[i]]++;
+    }
+}
+
+dudero_ret_t dudero_ctx_attach_bytes(dudero_ctx_t *ctx, dudero_bytes_t *bytes) {
+    if (bytes == NULL || ctx->hist_samples != 0) {
+        return DUDERO_RET_ERROR;
+    }
+    for (size_t v=0; v<256; v++) {
+        bytes->bins[v] = 0;
+    }
+    bytes->add = bytes_add;
+    ctx->bytes = bytes;
+    return DUDERO_RET_OK;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Byte frequency mode: a 256-bin histogram, one bin per byte value, on top
+// of the nibble one. Catches sources the nibbles can't tell apart from
+// uniform, e.g. one emitting only the 16 bytes 0x00, 0x11, ..., 0xFF.
+//
+// The counters (1 KiB) are attached by the caller, so dudero_ctx_t stays
+// small for embedded use; adding large buffers also takes 2 KiB of stack.
+// Same verdict API: once attached, dudero_ctx_finish() also fails on the
+// byte histogram, reported as DUDERO_TEST_BYTES by dudero_ctx_finish_tests().
+
+#include "dudero.h"
+
+typedef struct dudero_bytes {
+    uint32_t bins[256];
+    // private, set by dudero_ctx_attach_bytes()
+    void (*add)(uint32_t bins[256], const uint8_t *buf, size_t len);
+} dudero_bytes_t;
+
+// The byte test only runs from this many bytes on (5 per bin), below which
+// its chi-square approximation doesn't hold.
+#define DUDERO_BYTES_MIN_LEN (1280)
+
+// Chi-square critical values with 255 degrees of freedom, in Q16.16, for
+// alpha = 10^-k; dudero_ctx_set_alpha() picks the same k for both tests.
+#define DUDERO_BYTES_THRES_Q16_ALPHA_1  (18634238u) // 284.34
+#define DUDERO_BYTES_THRES_Q16_ALPHA_2  (20346135u) // 310.46
+#define DUDERO_BYTES_THRES_Q16_ALPHA_3  (21660942u) // 330.52
+#define DUDERO_BYTES_THRES_Q16_ALPHA_4  (22783866u) // 347.65
+#define DUDERO_BYTES_THRES_Q16_ALPHA_5  (23788835u) // 362.99
+#define DUDERO_BYTES_THRES_Q16_ALPHA_6  (24712191u) // 377.08
+#define DUDERO_BYTES_THRES_Q16_ALPHA_7  (25574904u) // 390.24
+#define DUDERO_BYTES_THRES_Q16_ALPHA_8  (26390340u) // 402.68
+#define DUDERO_BYTES_THRES_Q16_ALPHA_9  (27167624u) // 414.55
+#define DUDERO_BYTES_THRES_Q16_ALPHA_10 (27913308u) // 425.92
+#define DUDERO_BYTES_THRES_Q16_ALPHA_11 (28632279u) // 436.89
+#define DUDERO_BYTES_THRES_Q16_ALPHA_12 (29328296u) // 447.51
+// Same false positive rate as DUDERO_THRES_Q16_DEFAULT, ~7.7e-5
+#define DUDERO_BYTES_THRES_Q16_DEFAULT  (22905514u) // 349.51
+
+// Zeroes `bytes` and has ctx count bytes into it. Call right after
+// dudero_ctx_init(); `bytes` must outlive the use of ctx. DUDERO_RET_ERROR
+// if bytes is NULL or ctx already holds data.
+dudero_ret_t dudero_ctx_attach_bytes(dudero_ctx_t *ctx, dudero_bytes_t *bytes);
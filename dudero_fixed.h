@@ -0,0 +1,57 @@
+#pragma once
+
+// Checkers specialized at compile time for a fixed buffer length and
+// threshold. With both known to the compiler the expected bin count and
+// the scaled threshold fold into constants, and the whole check inlines
+// into the caller: no context, no call, no division.
+//
+//   DUDERO_DEFINE_CHECKER(check_key, 32, DUDERO_THRES_Q16_DEFAULT)
+//   ...
+//   if (check_key(key) != DUDERO_RET_OK) { ... }
+//
+// Verdicts are the same as dudero_check_buffer() with that threshold.
+
+#include "dudero.h"
+
+// Shared with dudero.c: bad if cum / expected > thres_q16 / 2^16.
+//
+// Done in integers only, cross-multiplied, so it needs no FPU (nor soft-float
+// routines) and gives exactly the verdict of the real-valued comparison.
+// expected <= 2^27 (DUDERO_MAX_LEN), so thres_q16 * expected < 2^59. If cum
+// is too large to shift by 16, the ratio is above 2^47 / 2^27, way past any
+// threshold representable in Q16.16.
+static inline dudero_ret_t dudero_fixed_verdict(uint64_t cum, uint64_t expected, uint32_t thres_q16) {
+    if (cum >= ((uint64_t)1 << 47)) {
+        return DUDERO_RET_BAD_RANDOMNESS;
+    }
+    if ((cum << 16) > (uint64_t)thres_q16 * expected) {
+        return DUDERO_RET_BAD_RANDOMNESS;
+    }
+    return DUDERO_RET_OK;
+}
+
+// Meant to be called with constant len and thres_q16, see DUDERO_DEFINE_CHECKER.
+static inline dudero_ret_t dudero_fixed_check(const uint8_t *buf, size_t len, uint32_t thres_q16) {
+    uint32_t hist[16] = {0};
+    for (size_t i=0; i<len; i++) {
+        hist[buf[i] >> 4]++;
+        hist[buf[i]&0x0F]++;
+    }
+    const uint64_t expected = (2*(uint64_t)len) / 16;
+    uint64_t cum = 0;
+    for (size_t i=0; i<16; i++) {
+        uint64_t delta = (hist[i] > expected) ? hist[i]-expected : expected-hist[i];
+        cum += delta*delta;
+    }
+    return dudero_fixed_verdict(cum, expected, thres_q16);
+}
+
+// Defines `static inline dudero_ret_t name(const uint8_t *buf)` checking
+// exactly len bytes against thres_q16 (e.g. DUDERO_THRES_Q16_DEFAULT).
+// len must be a constant between 16 and DUDERO_MAX_LEN, else it fails to
+// compile.
+#define DUDERO_DEFINE_CHECKER(name, len, thres_q16)                            \
+    typedef char name##_len_is_valid[((len) >= 16 && (len) <= DUDERO_MAX_LEN) ? 1 : -1]; \
+    static inline dudero_ret_t name(const uint8_t *buf) {                      \
+        return dudero_fixed_check(buf, (len), (thres_q16));                    \
+    }
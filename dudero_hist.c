@@ -0,0 +1,278 @@
+// Nibble histogram kernels, one per backend, and runtime CPU detection.
+//
+// The SIMD kernels all use the same scheme: split each vector into low and
+// high nibbles, compare them against the broadcast nibble values and
+// accumulate the matches into vectors of 8-bit counters, one per nibble
+// value. AVX-512 and NEON have the registers for all 16 counters and take a
+// block in one pass; SSE2 and AVX2 keep 8 at a time, so they take two
+// passes per block, the second re-reading it from L1.
+// A byte lane grows by at most 2 per step, so counters are folded into the
+// 32-bit hist (by summing lanes horizontally) every 127 steps, before they
+// can wrap. The hot loop thus only touches narrow, in-register counters.
+
+#include "dudero_internal.h"
+
+#if !defined(DUDERO_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define DUDERO_HAVE_X86 1
+# include <immintrin.h>
+#endif
+
+#if !defined(DUDERO_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+# define DUDERO_HAVE_NEON 1
+# include <arm_neon.h>
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  ifndef HWCAP_ASIMD
+#   define HWCAP_ASIMD (1 << 1)
+#  endif
+# endif
+#endif
+
+// max steps before 8-bit counters may wrap
+#define FLUSH_STEPS (127)
+
+// Below this the fixed cost of folding the counters outweighs the gain.
+#define SIMD_MIN_LEN (256)
+
+void dudero_hist_add_scalar(uint32_t hist[16], const uint8_t *buf, size_t len) {
+    // Unrolled by hand: the increments of four bytes are independent,
+    // except when they hit the same bin, so the CPU can overlap them.
+    size_t i = 0;
+    for (; i+4 <= len; i+=4) {
+        uint8_t b0 = buf[i], b1 = buf[i+1], b2 = buf[i+2], b3 = buf[i+3];
+        hist[b0 >> 4]++; hist[b0&0x0F]++;
+        hist[b1 >> 4]++; hist[b1&0x0F]++;
+        hist[b2 >> 4]++; hist[b2&0x0F]++;
+        hist[b3 >> 4]++; hist[b3&0x0F]++;
+    }
+    for (; i<len; i++) {
+        hist[buf[i] >> 4]++;
+        hist[buf[i]&0x0F]++;
+    }
+}
+
+#if defined(DUDERO_HAVE_X86)
+__attribute__((target("sse2")))
+static void hist_add_sse2(uint32_t hist[16], const uint8_t *buf, size_t len) {
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    while (len >= SIMD_MIN_LEN && len - i >= 16) {
+        size_t steps = (len - i) / 16;
+        if (steps > FLUSH_STEPS) {
+            steps = FLUSH_STEPS;
+        }
+        // 8 bins per pass, so the accumulators stay in registers; the
+        // second pass re-reads the block from L1
+        for (int half=0; half<16; half+=8) {
+            __m128i acc[8];
+            for (int v=0; v<8; v++) {
+                acc[v] = zero;
+            }
+            for (size_t s=0; s<steps; s++) {
+                __m128i x = _mm_loadu_si128((const __m128i *)(buf + i + 16*s));
+                __m128i lo = _mm_and_si128(x, mask);
+                __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+                DUDERO_UNROLL
+                for (int v=0; v<8; v++) {
+                    __m128i nib = _mm_set1_epi8((char)(half + v));
+                    __m128i m = _mm_add_epi8(_mm_cmpeq_epi8(lo, nib), _mm_cmpeq_epi8(hi, nib));
+                    acc[v] = _mm_sub_epi8(acc[v], m);
+                }
+            }
+            for (int v=0; v<8; v++) {
+                __m128i sum = _mm_sad_epu8(acc[v], zero);
+                hist[half + v] += (uint32_t)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+            }
+        }
+        i += 16*steps;
+    }
+    dudero_hist_add_scalar(hist, buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void hist_add_avx2(uint32_t hist[16], const uint8_t *buf, size_t len) {
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    while (len >= SIMD_MIN_LEN && len - i >= 32) {
+        size_t steps = (len - i) / 32;
+        if (steps > FLUSH_STEPS) {
+            steps = FLUSH_STEPS;
+        }
+        for (int half=0; half<16; half+=8) {
+            __m256i acc[8];
+            for (int v=0; v<8; v++) {
+                acc[v] = zero;
+            }
+            for (size_t s=0; s<steps; s++) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(buf + i + 32*s));
+                __m256i lo = _mm256_and_si256(x, mask);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+                DUDERO_UNROLL
+                for (int v=0; v<8; v++) {
+                    __m256i nib = _mm256_set1_epi8((char)(half + v));
+                    __m256i m = _mm256_add_epi8(_mm256_cmpeq_epi8(lo, nib), _mm256_cmpeq_epi8(hi, nib));
+                    acc[v] = _mm256_sub_epi8(acc[v], m);
+                }
+            }
+            for (int v=0; v<8; v++) {
+                __m256i sum = _mm256_sad_epu8(acc[v], zero);
+                __m128i sum2 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+                hist[half + v] += (uint32_t)(_mm_cvtsi128_si32(sum2) + _mm_cvtsi128_si32(_mm_srli_si128(sum2, 8)));
+            }
+        }
+        i += 32*steps;
+    }
+    dudero_hist_add_scalar(hist, buf + i, len - i);
+}
+
+// With 32 registers all 16 accumulators fit at once: one pass per block
+// instead of two. Compares give masks, counted with masked adds.
+__attribute__((target("avx512f,avx512bw")))
+static void hist_add_avx512(uint32_t hist[16], const uint8_t *buf, size_t len) {
+    const __m512i mask = _mm512_set1_epi8(0x0F);
+    const __m512i one = _mm512_set1_epi8(1);
+    const __m512i zero = _mm512_setzero_si512();
+    size_t i = 0;
+    while (len >= SIMD_MIN_LEN && len - i >= 64) {
+        size_t steps = (len - i) / 64;
+        if (steps > FLUSH_STEPS) {
+            steps = FLUSH_STEPS;
+        }
+        __m512i acc[16];
+        for (int v=0; v<16; v++) {
+            acc[v] = zero;
+        }
+        for (size_t s=0; s<steps; s++, i+=64) {
+            __m512i x = _mm512_loadu_si512((const void *)(buf + i));
+            __m512i lo = _mm512_and_si512(x, mask);
+            __m512i hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), mask);
+            DUDERO_UNROLL
+            for (int v=0; v<16; v++) {
+                __m512i nib = _mm512_set1_epi8((char)v);
+                acc[v] = _mm512_mask_add_epi8(acc[v], _mm512_cmpeq_epi8_mask(lo, nib), acc[v], one);
+                acc[v] = _mm512_mask_add_epi8(acc[v], _mm512_cmpeq_epi8_mask(hi, nib), acc[v], one);
+            }
+        }
+        for (int v=0; v<16; v++) {
+            hist[v] += (uint32_t)_mm512_reduce_add_epi64(_mm512_sad_epu8(acc[v], zero));
+        }
+    }
+    dudero_hist_add_scalar(hist, buf + i, len - i);
+}
+#endif // DUDERO_HAVE_X86
+
+#if defined(DUDERO_HAVE_NEON)
+static void hist_add_neon(uint32_t hist[16], const uint8_t *buf, size_t len) {
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    size_t i = 0;
+    while (len >= SIMD_MIN_LEN && len - i >= 16) {
+        size_t steps = (len - i) / 16;
+        if (steps > FLUSH_STEPS) {
+            steps = FLUSH_STEPS;
+        }
+        uint8x16_t acc[16];
+        for (int v=0; v<16; v++) {
+            acc[v] = vdupq_n_u8(0);
+        }
+        for (size_t s=0; s<steps; s++, i+=16) {
+            uint8x16_t x = vld1q_u8(buf + i);
+            uint8x16_t lo = vandq_u8(x, mask);
+            uint8x16_t hi = vshrq_n_u8(x, 4);
+            DUDERO_UNROLL
+            for (int v=0; v<16; v++) {
+                uint8x16_t nib = vdupq_n_u8((uint8_t)v);
+                acc[v] = vsubq_u8(acc[v], vceqq_u8(lo, nib));
+                acc[v] = vsubq_u8(acc[v], vceqq_u8(hi, nib));
+            }
+        }
+        for (int v=0; v<16; v++) {
+            hist[v] += vaddlvq_u8(acc[v]);
+        }
+    }
+    dudero_hist_add_scalar(hist, buf + i, len - i);
+}
+#endif // DUDERO_HAVE_NEON
+
+const dudero_hist_fn dudero_hist_kernels[DUDERO_BACKEND_COUNT] = {
+    [DUDERO_BACKEND_SCALAR] = dudero_hist_add_scalar,
+#if defined(DUDERO_HAVE_X86)
+    [DUDERO_BACKEND_SSE2] = hist_add_sse2,
+    [DUDERO_BACKEND_AVX2] = hist_add_avx2,
+    [DUDERO_BACKEND_AVX512] = hist_add_avx512,
+#endif
+#if defined(DUDERO_HAVE_NEON)
+    [DUDERO_BACKEND_NEON] = hist_add_neon,
+#endif
+};
+
+bool dudero_backend_supported(dudero_backend_t backend) {
+    if ((unsigned)backend >= DUDERO_BACKEND_COUNT || dudero_hist_kernels[backend] == NULL) {
+        return false;
+    }
+    switch (backend) {
+#if defined(DUDERO_HAVE_X86)
+    case DUDERO_BACKEND_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case DUDERO_BACKEND_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case DUDERO_BACKEND_AVX512:
+        // also checks the OS saves the zmm state
+        return __builtin_cpu_supports("avx512bw");
+#endif
+#if defined(DUDERO_HAVE_NEON) && defined(__linux__)
+    case DUDERO_BACKEND_NEON:
+        return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#endif
+    default:
+        return true;
+    }
+}
+
+// fastest first
+static const dudero_backend_t by_speed[] = {
+    DUDERO_BACKEND_AVX512, DUDERO_BACKEND_AVX2, DUDERO_BACKEND_SSE2, DUDERO_BACKEND_NEON,
+};
+
+static dudero_backend_t resolve_best(void) {
+    for (size_t i=0; i<sizeof by_speed / sizeof by_speed[0]; i++) {
+        if (dudero_backend_supported(by_speed[i])) {
+            return by_speed[i];
+        }
+    }
+    return DUDERO_BACKEND_SCALAR;
+}
+
+// Resolved on first use and cached: the CPU doesn't change under a running
+// process, so every dudero_ctx_init() after the first is a single load.
+// Threads racing on the first use all store the same value.
+static int best_backend = -1;
+
+dudero_backend_t dudero_backend_best(void) {
+#if defined(__GNUC__)
+    int b = __atomic_load_n(&best_backend, __ATOMIC_RELAXED);
+    if (b < 0) {
+        b = (int)resolve_best();
+        __atomic_store_n(&best_backend, b, __ATOMIC_RELAXED);
+    }
+#else
+    int b = best_backend;
+    if (b < 0) {
+        best_backend = b = (int)resolve_best();
+    }
+#endif
+    return (dudero_backend_t)b;
+}
+
+static const char *const backend_names[DUDERO_BACKEND_COUNT] = {
+    [DUDERO_BACKEND_SCALAR] = "scalar",
+    [DUDERO_BACKEND_SSE2] = "sse2",
+    [DUDERO_BACKEND_AVX2] = "avx2",
+    [DUDERO_BACKEND_NEON] = "neon",
+    [DUDERO_BACKEND_AVX512] = "avx512",
+};
+
+const char *dudero_backend_name(dudero_backend_t backend) {
+    return ((unsigned)backend < DUDERO_BACKEND_COUNT) ? backend_names[backend] : "unknown";
+}
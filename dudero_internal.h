@@ -0,0 +1,24 @@
+#pragma once
+
+// Library-private declarations shared between dudero translation units.
+// Not part of the public API.
+
+#include "dudero.h"
+
+// For loops over counters that must be fully unrolled so the counters live
+// in registers rather than on the stack.
+#if defined(__GNUC__)
+# define DUDERO_UNROLL _Pragma("GCC unroll 16")
+#else
+# define DUDERO_UNROLL
+#endif
+
+// Nibble histogram kernel: adds the high and low nibble of every byte in
+// buf to hist. All backends must produce exactly the same hist as
+// dudero_hist_add_scalar. len is at most DUDERO_MAX_LEN.
+typedef void (*dudero_hist_fn)(uint32_t hist[16], const uint8_t *buf, size_t len);
+
+void dudero_hist_add_scalar(uint32_t hist[16], const uint8_t *buf, size_t len);
+
+// Indexed by dudero_backend_t. NULL for backends not compiled in.
+extern const dudero_hist_fn dudero_hist_kernels[DUDERO_BACKEND_COUNT];
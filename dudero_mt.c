@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign
+
+#include "dudero_mt.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define CACHE_LINE (64)
+
+// below this, splitting costs more than it saves
+#define MIN_SHARD_LEN ((size_t)64 << 10)
+
+typedef struct {
+    dudero_ctx_t ctx;
+    dudero_ret_t ret;
+} shard_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t nshards;
+    uint8_t *shards; // nshards entries, stride bytes apart
+    size_t stride;
+} job_t;
+
+static shard_t *job_shard(job_t *job, size_t i) {
+    return (shard_t *)(job->shards + i*job->stride);
+}
+
+static void shard_run(void *arg, size_t i) {
+    job_t *job = arg;
+    shard_t *shard = job_shard(job, i);
+    size_t begin = job->len / job->nshards * i;
+    size_t end = (i+1 == job->nshards) ? job->len : job->len / job->nshards * (i+1);
+
+    dudero_ctx_init(&shard->ctx);
+    shard->ret = dudero_ctx_add_buf(&shard->ctx, job->buf + begin, end - begin);
+}
+
+dudero_ret_t dudero_check_buffer_pool(const uint8_t *buf, size_t len, size_t nshards,
+                                      dudero_parallel_for_fn run, void *pool) {
+    if (len > DUDERO_MAX_LEN) {
+        return DUDERO_RET_TOO_LONG;
+    }
+    if (nshards > len / MIN_SHARD_LEN) {
+        nshards = len / MIN_SHARD_LEN;
+    }
+    if (nshards <= 1) {
+        return dudero_check_buffer(buf, len);
+    }
+
+    // one shard per cache line (or more), so threads never write to the same one
+    job_t job = {buf, len, nshards, NULL, (sizeof(shard_t) + CACHE_LINE-1) / CACHE_LINE * CACHE_LINE};
+    void *shards;
+    if (posix_memalign(&shards, CACHE_LINE, nshards * job.stride) != 0) {
+        return DUDERO_RET_ERROR;
+    }
+    job.shards = shards;
+
+    run(pool, nshards, shard_run, &job);
+
+    dudero_ctx_t total;
+    dudero_ctx_init(&total);
+    dudero_ret_t ret = DUDERO_RET_OK;
+    for (size_t i=0; i<nshards && ret == DUDERO_RET_OK; i++) {
+        ret = job_shard(&job, i)->ret;
+        if (ret == DUDERO_RET_OK) {
+            ret = dudero_ctx_merge(&total, &job_shard(&job, i)->ctx);
+        }
+    }
+    free(shards);
+    if (ret != DUDERO_RET_OK) {
+        return ret;
+    }
+    return dudero_ctx_finish(&total);
+}
+
+typedef struct {
+    void (*job)(void *arg, size_t i);
+    void *arg;
+    size_t i;
+} thread_arg_t;
+
+static void *thread_main(void *p) {
+    thread_arg_t *t = p;
+    t->job(t->arg, t->i);
+    return NULL;
+}
+
+// dudero_parallel_for_fn on plain pthreads: one thread per job, job 0 runs
+// on the calling thread. If a thread can't be created its job runs inline.
+static void pthread_parallel_for(void *pool, size_t n, void (*job)(void *arg, size_t i), void *arg) {
+    (void)pool;
+    pthread_t *threads = malloc(n * sizeof *threads);
+    thread_arg_t *args = malloc(n * sizeof *args);
+    bool *started = calloc(n, sizeof *started);
+    if (threads == NULL || args == NULL || started == NULL) {
+        for (size_t i=0; i<n; i++) {
+            job(arg, i);
+        }
+    } else {
+        for (size_t i=1; i<n; i++) {
+            args[i] = (thread_arg_t){job, arg, i};
+            started[i] = pthread_create(&threads[i], NULL, thread_main, &args[i]) == 0;
+            if (!started[i]) {
+                job(arg, i);
+            }
+        }
+        job(arg, 0);
+        for (size_t i=1; i<n; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+    free(threads);
+    free(args);
+    free(started);
+}
+
+dudero_ret_t dudero_check_buffer_mt(const uint8_t *buf, size_t len, unsigned nthreads) {
+    return dudero_check_buffer_pool(buf, len, nthreads, pthread_parallel_for, NULL);
+}
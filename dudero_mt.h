@@ -0,0 +1,23 @@
+#pragma once
+
+// Parallel check of one large buffer: the buffer is split into shards, each
+// shard gets its own histogram (in its own cache lines), and the histograms
+// are merged before the final statistic. Histograms add up exactly, so the
+// result is bit-identical to dudero_check_buffer().
+//
+// Needs threads: link with -pthread.
+
+#include "dudero.h"
+
+// Checks buf using up to nthreads POSIX threads (the calling one included).
+// Small buffers use fewer threads; nthreads <= 1 is plain
+// dudero_check_buffer(). DUDERO_RET_ERROR if out of memory.
+dudero_ret_t dudero_check_buffer_mt(const uint8_t *buf, size_t len, unsigned nthreads);
+
+// Bring your own thread pool: must run job(arg, i) for every i in [0, n),
+// in any order and on any threads, and return once all of them are done.
+typedef void (*dudero_parallel_for_fn)(void *pool, size_t n, void (*job)(void *arg, size_t i), void *arg);
+
+// Same as dudero_check_buffer_mt(), running nshards jobs on `pool` via `run`.
+dudero_ret_t dudero_check_buffer_pool(const uint8_t *buf, size_t len, size_t nshards,
+                                      dudero_parallel_for_fn run, void *pool);
@@ -0,0 +1,65 @@
+// Transition counting kernel. Within a byte the pair (high, low) is the
+// byte itself; across bytes it's (low of the previous, high of this one).
+// The two kinds go to separate 16-bit tables, so the two increments of a
+// byte never wait on each other, and both tables (1 KiB) stay in L1 next
+// to the data. They're folded into the 32-bit cells before they can wrap.
+
+#include "dudero_pairs.h"
+
+// each table gets one increment per byte
+#define FOLD_LEN ((size_t)65535)
+// below this, zeroing and folding the tables costs more than it saves
+#define TABLES_MIN_LEN (1024)
+
+static void pairs_add(dudero_pairs_t *pairs, const uint8_t *buf, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    size_t i = 0;
+    if (!pairs->have_last) {
+        // the very first byte has no predecessor
+        pairs->cells[buf[0]]++;
+        pairs->last = buf[0] & 0x0F;
+        pairs->have_last = true;
+        i = 1;
+    }
+    uint8_t last = pairs->last;
+    while (len - i >= TABLES_MIN_LEN) {
+        size_t n = (len - i < FOLD_LEN) ? len - i : FOLD_LEN;
+        uint16_t within[256], across[256];
+        for (size_t v=0; v<256; v++) {
+            within[v] = across[v] = 0;
+        }
+        for (const uint8_t *p = buf + i, *end = buf + i + n; p < end; p++) {
+            const uint8_t b = *p;
+            within[b]++;
+            across[(uint8_t)((last << 4) | (b >> 4))]++;
+            last = b & 0x0F;
+        }
+        for (size_t v=0; v<256; v++) {
+            pairs->cells[v] += (uint32_t)within[v] + across[v];
+        }
+        i += n;
+    }
+    for (; i<len; i++) {
+        const uint8_t b = buf[i];
+        pairs->cells[b]++;
+        pairs->cells[(uint8_t)((last << 4) | (b >> 4))]++;
+        last = b & 0x0F;
+    }
+    pairs->last = last;
+}
+
+dudero_ret_t dudero_ctx_attach_pairs(dudero_ctx_t *ctx, dudero_pairs_t *pairs) {
+    if (pairs == NULL || ctx->hist_samples != 0) {
+        return DUDERO_RET_ERROR;
+    }
+    for (size_t v=0; v<256; v++) {
+        pairs->cells[v] = 0;
+    }
+    pairs->last = 0;
+    pairs->have_last = false;
+    pairs->add = pairs_add;
+    ctx->pairs = pairs;
+    return DUDERO_RET_OK;
+}
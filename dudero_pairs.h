@@ -0,0 +1,51 @@
+#pragma once
+
+// Nibble transition test: a 16x16 table of how often nibble j follows
+// nibble i, over the whole nibble stream (high then low nibble of each
+// byte). Catches serial correlation the marginal frequencies can't see,
+// e.g. a balanced but deterministic sequence such as 0x01 0x23 ... 0xEF
+// repeated.
+//
+// The statistic is Good's serial test, the pair statistic minus the
+// single nibble one, chi-square with 240 degrees of freedom, so it doesn't
+// fail twice for what the frequency test already caught.
+//
+// As with dudero_bytes.h the counters (1 KiB) are attached by the caller,
+// and adding large buffers takes 1 KiB of stack. Once attached,
+// dudero_ctx_finish() also fails on the transitions, reported as
+// DUDERO_TEST_PAIRS by dudero_ctx_finish_tests().
+
+#include "dudero.h"
+
+typedef struct dudero_pairs {
+    uint32_t cells[256]; // cells[16*i + j]: nibble j right after nibble i
+    // private, set by dudero_ctx_attach_pairs()
+    uint8_t last; // low nibble of the last byte, if have_last
+    bool have_last;
+    void (*add)(struct dudero_pairs *pairs, const uint8_t *buf, size_t len);
+} dudero_pairs_t;
+
+// The pair test only runs from this many bytes on (5 transitions per cell).
+#define DUDERO_PAIRS_MIN_LEN (640)
+
+// Chi-square critical values with 240 degrees of freedom, in Q16.16, for
+// alpha = 10^-k; dudero_ctx_set_alpha() picks the same k for all tests.
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_1  (17594499u) // 268.47
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_2  (19260251u) // 293.89
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_3  (20541401u) // 313.44
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_4  (21636689u) // 330.15
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_5  (22617725u) // 345.12
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_6  (23519713u) // 358.88
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_7  (24362969u) // 371.75
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_8  (25160441u) // 383.92
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_9  (25920970u) // 395.52
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_10 (26650901u) // 406.66
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_11 (27354970u) // 417.40
+#define DUDERO_PAIRS_THRES_Q16_ALPHA_12 (28036819u) // 427.81
+// Same false positive rate as DUDERO_THRES_Q16_DEFAULT, ~7.7e-5
+#define DUDERO_PAIRS_THRES_Q16_DEFAULT  (21755401u) // 331.96
+
+// Zeroes `pairs` and has ctx count transitions into it. Call right after
+// dudero_ctx_init(); `pairs` must outlive the use of ctx. DUDERO_RET_ERROR
+// if pairs is NULL or ctx already holds data.
+dudero_ret_t dudero_ctx_attach_pairs(dudero_ctx_t *ctx, dudero_pairs_t *pairs);
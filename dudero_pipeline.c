@@ -0,0 +1,223 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign
+
+#include "dudero_pipeline.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE (64)
+
+// Slot i of the ring holds block number i % nblocks. The three indices only
+// grow, and each has a single writer:
+//
+//   tail <= head     blocks the consumer has taken
+//   checked <= head  blocks the worker has a verdict for
+//   head             blocks the producer has pushed
+//
+// A slot is free again once both the worker and the consumer are past it.
+// Each index gets its own cache line so the three sides don't false-share.
+typedef struct {
+    size_t value;
+    char pad[CACHE_LINE - sizeof(size_t)];
+} index_t;
+
+struct dudero_pipeline {
+    index_t head;
+    index_t checked;
+    index_t tail;
+
+    int status;        // dudero_ret_t, sticky BAD_RANDOMNESS
+    int stop;
+    int sleeping;      // worker is waiting on `wake`
+    int stopped;       // worker has exited, under `lock`
+    int draining;      // threads in dudero_pipeline_drain()
+
+    size_t block_len;
+    size_t nblocks;
+    dudero_release_t policy;
+    unsigned tests;
+    uint8_t *data;
+
+    pthread_mutex_t lock; // only for sleeping, waking up and stopping
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    pthread_t worker;
+};
+
+static size_t load(const size_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store(size_t *p, size_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static uint8_t *slot(const dudero_pipeline_t *p, size_t i) {
+    return p->data + (i % p->nblocks) * p->block_len;
+}
+
+static dudero_ret_t check_block(const dudero_pipeline_t *p, const uint8_t *block) {
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_enable_tests(&ctx, p->tests);
+    dudero_ret_t ret = dudero_ctx_add_buf(&ctx, block, p->block_len);
+    if (ret != DUDERO_RET_OK) {
+        return ret;
+    }
+    return dudero_ctx_finish(&ctx);
+}
+
+// Sleeps until there's a new block or we're told to stop. The worker flags
+// itself as sleeping before looking at `head` one last time, and the
+// producer looks at the flag after moving `head` (both seq_cst): either
+// the worker sees the block, or the producer sees it must wake it up.
+static void wait_for_work(dudero_pipeline_t *p, size_t next) {
+    pthread_mutex_lock(&p->lock);
+    __atomic_store_n(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&p->head.value, __ATOMIC_SEQ_CST) == next &&
+           !__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&p->wake, &p->lock);
+    }
+    __atomic_store_n(&p->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *worker_main(void *arg) {
+    dudero_pipeline_t *p = arg;
+    size_t next = p->checked.value;
+    while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+        if (load(&p->head.value) == next) {
+            wait_for_work(p, next);
+            continue;
+        }
+        if (check_block(p, slot(p, next)) != DUDERO_RET_OK) {
+            __atomic_store_n(&p->status, DUDERO_RET_BAD_RANDOMNESS, __ATOMIC_RELEASE);
+        }
+        // A failed block is only counted as checked after `status` is set,
+        // so the after-verdict policy can never release it.
+        __atomic_store_n(&p->checked.value, ++next, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&p->draining, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&p->lock);
+            pthread_cond_broadcast(&p->done);
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    // nothing gets checked from here on, let drainers go
+    pthread_mutex_lock(&p->lock);
+    p->stopped = 1;
+    pthread_cond_broadcast(&p->done);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+dudero_pipeline_t *dudero_pipeline_create(size_t block_len, size_t nblocks,
+                                          dudero_release_t policy, unsigned tests) {
+    if (block_len < 16 || block_len > DUDERO_MAX_LEN || nblocks == 0 ||
+        nblocks > SIZE_MAX / block_len || (tests & ~DUDERO_TEST_ALL) ||
+        (policy != DUDERO_RELEASE_BEFORE_VERDICT && policy != DUDERO_RELEASE_AFTER_VERDICT)) {
+        return NULL;
+    }
+    void *mem;
+    if (posix_memalign(&mem, CACHE_LINE, sizeof(dudero_pipeline_t)) != 0) {
+        return NULL;
+    }
+    dudero_pipeline_t *p = mem;
+    memset(p, 0, sizeof *p);
+    p->status = DUDERO_RET_OK;
+    p->block_len = block_len;
+    p->nblocks = nblocks;
+    p->policy = policy;
+    p->tests = tests;
+    if (posix_memalign(&mem, CACHE_LINE, nblocks * block_len) != 0) {
+        free(p);
+        return NULL;
+    }
+    p->data = mem;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+    if (pthread_create(&p->worker, NULL, worker_main, p) != 0) {
+        pthread_cond_destroy(&p->done);
+        pthread_cond_destroy(&p->wake);
+        pthread_mutex_destroy(&p->lock);
+        free(p->data);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void dudero_pipeline_destroy(dudero_pipeline_t *p) {
+    if (p == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->worker, NULL);
+    // wait for drainers the worker let go to leave
+    pthread_mutex_lock(&p->lock);
+    while (p->draining) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    free(p->data);
+    free(p);
+}
+
+bool dudero_pipeline_push(dudero_pipeline_t *p, const uint8_t *block) {
+    size_t head = p->head.value;
+    size_t checked = load(&p->checked.value), tail = load(&p->tail.value);
+    if (head - (checked < tail ? checked : tail) == p->nblocks) {
+        return false;
+    }
+    memcpy(slot(p, head), block, p->block_len);
+    __atomic_store_n(&p->head.value, head + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return true;
+}
+
+bool dudero_pipeline_pop(dudero_pipeline_t *p, uint8_t *out) {
+    size_t tail = p->tail.value;
+    if (p->policy == DUDERO_RELEASE_AFTER_VERDICT) {
+        if (tail == load(&p->checked.value) || dudero_pipeline_status(p) != DUDERO_RET_OK) {
+            return false;
+        }
+    } else if (tail == load(&p->head.value)) {
+        return false;
+    }
+    memcpy(out, slot(p, tail), p->block_len);
+    store(&p->tail.value, tail + 1);
+    return true;
+}
+
+dudero_ret_t dudero_pipeline_status(const dudero_pipeline_t *p) {
+    return (dudero_ret_t)__atomic_load_n(&p->status, __ATOMIC_ACQUIRE);
+}
+
+uint64_t dudero_pipeline_checked(const dudero_pipeline_t *p) {
+    return load(&p->checked.value);
+}
+
+void dudero_pipeline_drain(dudero_pipeline_t *p) {
+    size_t head = load(&p->head.value);
+    pthread_mutex_lock(&p->lock);
+    __atomic_add_fetch(&p->draining, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&p->checked.value, __ATOMIC_SEQ_CST) < head && !p->stopped) {
+        pthread_cond_wait(&p->done, &p->lock);
+    }
+    if (__atomic_sub_fetch(&p->draining, 1, __ATOMIC_SEQ_CST) == 0 && p->stopped) {
+        // dudero_pipeline_destroy() waits for us
+        pthread_cond_broadcast(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Background health checking. The RNG producer pushes fixed-size blocks
+// into a lock-free single-producer/single-consumer ring; a worker thread
+// checks each block and publishes the health status, which consumers poll
+// with a single atomic load. Neither side ever waits for a check.
+//
+// The policy decides when consumers get a block: right away, while it's
+// still being checked (lowest latency, the status tells afterwards if the
+// source went bad), or only once it passed.
+//
+// Needs threads: link with -pthread.
+
+#include "dudero.h"
+
+typedef enum {
+    DUDERO_RELEASE_BEFORE_VERDICT,
+    // Fails closed: once a block failed no further block is released.
+    DUDERO_RELEASE_AFTER_VERDICT,
+} dudero_release_t;
+
+typedef struct dudero_pipeline dudero_pipeline_t;
+
+// Ring of nblocks blocks of block_len bytes each, checked with the
+// DUDERO_TEST_* set `tests` (see dudero_ctx_enable_tests()), and the worker
+// thread. NULL if block_len is out of [16, DUDERO_MAX_LEN], tests or policy
+// are unknown, or out of memory/threads.
+dudero_pipeline_t *dudero_pipeline_create(size_t block_len, size_t nblocks,
+                                          dudero_release_t policy, unsigned tests);
+// Stops the worker; blocks not yet checked are dropped. Threads waiting in
+// dudero_pipeline_drain() return, and this returns once they have.
+void dudero_pipeline_destroy(dudero_pipeline_t *p);
+
+// Producer side: copies block_len bytes into the ring. false if it's full.
+bool dudero_pipeline_push(dudero_pipeline_t *p, const uint8_t *block);
+// Consumer side: copies the next released block to out. false if none.
+bool dudero_pipeline_pop(dudero_pipeline_t *p, uint8_t *out);
+
+// DUDERO_RET_OK, or DUDERO_RET_BAD_RANDOMNESS once any block failed. Sticky.
+dudero_ret_t dudero_pipeline_status(const dudero_pipeline_t *p);
+// Number of blocks checked so far.
+uint64_t dudero_pipeline_checked(const dudero_pipeline_t *p);
+// Waits until every block pushed so far has been checked, or the worker
+// stopped (dudero_pipeline_destroy()), with some of them left unchecked.
+void dudero_pipeline_drain(dudero_pipeline_t *p);
@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign
+
+#include "dudero_tls.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE (64)
+
+// One per thread, reused once the thread exits. Only its thread touches
+// ctx; pub is written by it and read by aggregators, under seq: odd while
+// a write is in progress. Cache line aligned and padded, so the stores of
+// one thread don't false-share with another's slot.
+typedef struct slot {
+    dudero_ctx_t ctx;
+    unsigned seq;
+    dudero_snapshot_t pub;
+    dudero_tls_t *owner;
+    struct slot *next;      // all slots, under lock
+    struct slot *next_free; // free slots, under lock
+} slot_t;
+
+struct dudero_tls {
+    dudero_fill_fn fill;
+    size_t period;
+    unsigned tests;
+    int status;       // dudero_ret_t, sticky BAD_RANDOMNESS
+    uint64_t checked;
+    pthread_key_t key;
+    pthread_mutex_t lock; // slot lists only, never on the fast path
+    slot_t *slots;
+    slot_t *free;
+};
+
+// zeroed, on cache lines of its own
+static void *zalloc_aligned(size_t size) {
+    void *mem;
+    size = (size + CACHE_LINE-1) / CACHE_LINE * CACHE_LINE;
+    if (posix_memalign(&mem, CACHE_LINE, size) != 0) {
+        return NULL;
+    }
+    memset(mem, 0, size);
+    return mem;
+}
+
+static void ctx_reset(const dudero_tls_t *t, slot_t *s) {
+    dudero_ctx_init(&s->ctx);
+    dudero_ctx_enable_tests(&s->ctx, t->tests);
+}
+
+static void publish(slot_t *s) {
+    unsigned seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i=0; i<16; i++) {
+        __atomic_store_n(&s->pub.hist[i], s->ctx.hist[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->pub.samples, s->ctx.hist_samples, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void read_published(slot_t *s, dudero_snapshot_t *out) {
+    unsigned before, after;
+    do {
+        before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        for (size_t i=0; i<16; i++) {
+            out->hist[i] = __atomic_load_n(&s->pub.hist[i], __ATOMIC_RELAXED);
+        }
+        out->samples = __atomic_load_n(&s->pub.samples, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+static void check_period(dudero_tls_t *t, slot_t *s) {
+    if (dudero_ctx_finish(&s->ctx) == DUDERO_RET_BAD_RANDOMNESS) {
+        __atomic_store_n(&t->status, DUDERO_RET_BAD_RANDOMNESS, __ATOMIC_RELEASE);
+    }
+    __atomic_fetch_add(&t->checked, 1, __ATOMIC_RELAXED);
+    ctx_reset(t, s);
+}
+
+// key destructor: checks what the thread left and frees its slot
+static void slot_release(void *arg) {
+    slot_t *s = arg;
+    dudero_tls_t *t = s->owner;
+    if (s->ctx.hist_samples >= 2*16) {
+        check_period(t, s);
+    }
+    ctx_reset(t, s);
+    publish(s);
+    pthread_mutex_lock(&t->lock);
+    s->next_free = t->free;
+    t->free = s;
+    pthread_mutex_unlock(&t->lock);
+}
+
+static slot_t *slot_get(dudero_tls_t *t) {
+    slot_t *s = pthread_getspecific(t->key);
+    if (s != NULL) {
+        return s;
+    }
+    pthread_mutex_lock(&t->lock);
+    if ((s = t->free) != NULL) {
+        t->free = s->next_free;
+    } else if ((s = zalloc_aligned(sizeof *s)) != NULL) {
+        s->owner = t;
+        s->next = t->slots;
+        t->slots = s;
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (s == NULL) {
+        return NULL;
+    }
+    ctx_reset(t, s);
+    pthread_setspecific(t->key, s);
+    return s;
+}
+
+dudero_tls_t *dudero_tls_create(dudero_fill_fn fill, size_t period, unsigned tests) {
+    if (fill == NULL || period < 16 || period > DUDERO_MAX_LEN || (tests & ~DUDERO_TEST_ALL)) {
+        return NULL;
+    }
+    dudero_tls_t *t = zalloc_aligned(sizeof *t);
+    if (t == NULL) {
+        return NULL;
+    }
+    t->fill = fill;
+    t->period = period;
+    t->tests = tests;
+    t->status = DUDERO_RET_OK;
+    if (pthread_key_create(&t->key, slot_release) != 0) {
+        free(t);
+        return NULL;
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+void dudero_tls_destroy(dudero_tls_t *t) {
+    if (t == NULL) {
+        return;
+    }
+    pthread_key_delete(t->key);
+    for (slot_t *s = t->slots, *next; s != NULL; s = next) {
+        next = s->next;
+        free(s);
+    }
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+int dudero_tls_randombytes(dudero_tls_t *t, void *buf, size_t n) {
+    if (dudero_tls_status(t) != DUDERO_RET_OK) {
+        return 1;
+    }
+    slot_t *s = slot_get(t);
+    if (s == NULL) {
+        return -1;
+    }
+    uint8_t *p = buf;
+    int ret = 0;
+    while (n > 0 && ret == 0) {
+        size_t room = t->period - (size_t)(s->ctx.hist_samples / 2);
+        size_t chunk = (n < room) ? n : room;
+        ret = t->fill(p, chunk, &s->ctx);
+        if (ret == 0 && chunk == room) {
+            check_period(t, s);
+        }
+        p += chunk;
+        n -= chunk;
+    }
+    publish(s);
+    if (ret == 0 && dudero_tls_status(t) != DUDERO_RET_OK) {
+        return 1;
+    }
+    return ret;
+}
+
+dudero_ret_t dudero_tls_status(const dudero_tls_t *t) {
+    return (dudero_ret_t)__atomic_load_n(&t->status, __ATOMIC_ACQUIRE);
+}
+
+uint64_t dudero_tls_checked(const dudero_tls_t *t) {
+    return __atomic_load_n(&t->checked, __ATOMIC_RELAXED);
+}
+
+dudero_ret_t dudero_tls_snapshot(dudero_tls_t *t, dudero_snapshot_t *out) {
+    dudero_ctx_t empty;
+    dudero_ctx_init(&empty);
+    dudero_ctx_snapshot(&empty, out);
+    dudero_ret_t ret = DUDERO_RET_OK;
+    pthread_mutex_lock(&t->lock);
+    for (slot_t *s = t->slots; s != NULL && ret == DUDERO_RET_OK; s = s->next) {
+        dudero_snapshot_t snap;
+        read_published(s, &snap);
+        ret = dudero_snapshot_merge(out, &snap);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Health checking for an RNG shared by many threads, without a lock on the
+// fast path. Each thread calling dudero_tls_randombytes() gets its own
+// context, kept across calls: its bytes accumulate there and are checked
+// every `period` bytes; a failure sets a status shared by all threads.
+//
+// After each call the thread publishes a snapshot of its period in
+// progress under a sequence lock, so an aggregator can merge the in-flight
+// data of every thread at any time (dudero_tls_snapshot()) without ever
+// stopping them. Checking scales with the number of threads.
+//
+// Threads are tracked with a POSIX thread-specific key. Per-CPU contexts
+// would need restartable sequences (rseq) to be safe without locks, so
+// they aren't offered. Needs threads: link with -pthread.
+
+#include "dudero.h"
+
+// Fills buf with n random bytes and feeds them to `check`: same contract
+// as randombytes_checked() (randombytes/randombytes.h), which fits as is.
+typedef int (*dudero_fill_fn)(void *buf, size_t n, struct dudero_ctx *check);
+
+typedef struct dudero_tls dudero_tls_t;
+
+// Checks every period bytes of each thread with the DUDERO_TEST_* set
+// `tests`. NULL if period is out of [16, DUDERO_MAX_LEN], tests are
+// unknown, or out of memory.
+dudero_tls_t *dudero_tls_create(dudero_fill_fn fill, size_t period, unsigned tests);
+// Only once no thread uses t anymore.
+void dudero_tls_destroy(dudero_tls_t *t);
+
+// Fills buf through `fill`, checking on the calling thread's context.
+// Returns 0 on success, -1 on error of the source (or out of memory), and
+// 1 if the status is bad: don't use buf. It was filled if this call made
+// the status bad, and is left as it was if the status already was.
+int dudero_tls_randombytes(dudero_tls_t *t, void *buf, size_t n);
+
+// DUDERO_RET_OK, or DUDERO_RET_BAD_RANDOMNESS once any period failed. Sticky.
+dudero_ret_t dudero_tls_status(const dudero_tls_t *t);
+// Number of periods checked so far, over all threads. A thread exiting
+// checks its period in progress, if it holds at least 16 bytes.
+uint64_t dudero_tls_checked(const dudero_tls_t *t);
+// Merges the periods in progress of all threads into *out, for a verdict
+// with dudero_snapshot_evaluate(). Same errors as dudero_snapshot_merge().
+dudero_ret_t dudero_tls_snapshot(dudero_tls_t *t, dudero_snapshot_t *out);
@@ -6,6 +6,10 @@
 #endif /* defined(__linux__) || defined(__GNU__) */
 
 #include "randombytes.h"
+#include "../dudero.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 #if defined(_WIN32)
 /* Windows */
@@ -38,6 +42,7 @@
 # include <stdint.h>
 # include <stdio.h>
 # include <sys/ioctl.h>
+# include <sys/mman.h>
 # if (defined(__linux__) || defined(__GNU__)) && defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ > 24))
 #  define USE_GLIBC
 #  include <sys/random.h>
@@ -52,6 +57,13 @@
 #  define SSIZE_MAX (SIZE_MAX / 2 - 1)
 # endif /* defined(SSIZE_MAX) */
 
+/* Takes the /dev/urandom path of systems without getrandom, so that it can
+ * be built and tested on current ones (make test-urandom) */
+# if defined(RANDOMBYTES_NO_GETRANDOM)
+#  undef USE_GLIBC
+#  undef SYS_getrandom
+# endif /* defined(RANDOMBYTES_NO_GETRANDOM) */
+
 #endif /* defined(__linux__) || defined(__GNU__) || defined(GNU_KFREEBSD) */
 
 
@@ -75,6 +87,18 @@
 #endif /* defined(__EMSCRIPTEN__) */
 
 
+/* randombytes_checked() hands the data to dudero in chunks of this size,
+ * so they are checked while still in L1 */
+#define RANDOMBYTES_CHECK_CHUNK 4096
+
+/* Feeds a freshly produced chunk to the health check, if any. Returns 0, or
+ * 1 if the context rejected it (fail-fast verdict or past its length). */
+static int randombytes_feed(dudero_ctx_t *check, const void *chunk, size_t len)
+{
+	if (check == NULL || len == 0) return 0;
+	return dudero_ctx_add_buf(check, (const uint8_t *)chunk, len) == DUDERO_RET_OK ? 0 : 1;
+}
+
 #if defined(_WIN32)
 static int randombytes_win32_randombytes(void* buf, size_t n)
 {
@@ -118,7 +142,7 @@ static ssize_t getrandom(void *buf, size_t buflen, unsigned int flags) {
 }
 # endif
 
-static int randombytes_linux_randombytes_getrandom(void *buf, size_t n)
+static int randombytes_linux_randombytes_getrandom(void *buf, size_t n, dudero_ctx_t *check)
 {
 	/* I have thought about using a separate PRF, seeded by getrandom, but
 	 * it turns out that the performance of getrandom is good enough
@@ -129,10 +153,14 @@ static int randombytes_linux_randombytes_getrandom(void *buf, size_t n)
 	while (n > 0) {
 		/* getrandom does not allow chunks larger than 33554431 */
 		chunk = n <= 33554431 ? n : 33554431;
+		if (check != NULL && chunk > RANDOMBYTES_CHECK_CHUNK) {
+			chunk = RANDOMBYTES_CHECK_CHUNK;
+		}
 		do {
 			ret = getrandom((char *)buf + offset, chunk, 0);
 		} while (ret == -1 && errno == EINTR);
 		if (ret < 0) return ret;
+		if (randombytes_feed(check, (char *)buf + offset, ret)) return 1;
 		offset += ret;
 		n -= ret;
 	}
@@ -255,33 +283,78 @@ static int randombytes_linux_wait_for_entropy(int device)
 # endif /* defined(__linux__) */
 
 
-static int randombytes_linux_randombytes_urandom(void *buf, size_t n)
+# if defined(__linux__)
+/* Set once the kernel pool has been seen initialized. That never reverts,
+ * and holds for the whole system, so this is shared by all threads and
+ * inherited as is by forked children: only the first call probes. A fork
+ * in the middle of a probe leaves it unset, and the child probes again. */
+static int randombytes_linux_entropy_ready;
+
+#  if defined(__GNUC__)
+#   define RANDOMBYTES_LATCH_GET(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#   define RANDOMBYTES_LATCH_SET(p) __atomic_store_n((p), 1, __ATOMIC_RELEASE)
+#  else
+/* No atomics: probe every time */
+#   define RANDOMBYTES_LATCH_GET(p) 0
+#   define RANDOMBYTES_LATCH_SET(p) ((void)(p))
+#  endif
+# endif /* defined(__linux__) */
+
+/* Opens /dev/urandom once it has been seeded */
+static int randombytes_linux_open_urandom(void)
 {
 	int fd;
-	size_t offset = 0, count;
-	ssize_t tmp;
 	do {
 		fd = open("/dev/urandom", O_RDONLY);
 	} while (fd == -1 && errno == EINTR);
 	if (fd == -1) return -1;
 # if defined(__linux__)
-	if (randombytes_linux_wait_for_entropy(fd) == -1) return -1;
+	if (!RANDOMBYTES_LATCH_GET(&randombytes_linux_entropy_ready)) {
+		if (randombytes_linux_wait_for_entropy(fd) == -1) {
+			close(fd);
+			return -1;
+		}
+		RANDOMBYTES_LATCH_SET(&randombytes_linux_entropy_ready);
+	}
 # endif
+	return fd;
+}
 
+/* Reads n bytes from an open /dev/urandom, feeding check as it goes */
+static int randombytes_linux_read_urandom(int fd, void *buf, size_t n, dudero_ctx_t *check)
+{
+	size_t offset = 0, count;
+	ssize_t tmp;
 	while (n > 0) {
 		count = n <= SSIZE_MAX ? n : SSIZE_MAX;
+		if (check != NULL && count > RANDOMBYTES_CHECK_CHUNK) {
+			count = RANDOMBYTES_CHECK_CHUNK;
+		}
 		tmp = read(fd, (char *)buf + offset, count);
 		if (tmp == -1 && (errno == EAGAIN || errno == EINTR)) {
 			continue;
 		}
-		if (tmp == -1) return -1; /* Unrecoverable IO error */
+		if (tmp == -1) {
+			return -1; /* Unrecoverable IO error */
+		}
+		if (randombytes_feed(check, (char *)buf + offset, tmp)) {
+			return 1;
+		}
 		offset += tmp;
 		n -= tmp;
 	}
-	close(fd);
 	assert(n == 0);
 	return 0;
 }
+
+static int randombytes_linux_randombytes_urandom(void *buf, size_t n, dudero_ctx_t *check)
+{
+	int ret, fd = randombytes_linux_open_urandom();
+	if (fd == -1) return -1;
+	ret = randombytes_linux_read_urandom(fd, buf, n, check);
+	close(fd);
+	return ret;
+}
 #endif /* defined(__linux__) && !defined(SYS_getrandom) */
 
 
@@ -334,15 +407,15 @@ int randombytes(void *buf, size_t n)
 # if defined(USE_GLIBC)
 #  pragma message("Using getrandom function call")
 	/* Use getrandom system call */
-	return randombytes_linux_randombytes_getrandom(buf, n);
+	return randombytes_linux_randombytes_getrandom(buf, n, NULL);
 # elif defined(SYS_getrandom)
 #  pragma message("Using getrandom system call")
 	/* Use getrandom system call */
-	return randombytes_linux_randombytes_getrandom(buf, n);
+	return randombytes_linux_randombytes_getrandom(buf, n, NULL);
 # else
 #  pragma message("Using /dev/urandom device")
 	/* When we have enough entropy, we can read from /dev/urandom */
-	return randombytes_linux_randombytes_urandom(buf, n);
+	return randombytes_linux_randombytes_urandom(buf, n, NULL);
 # endif
 #elif defined(BSD)
 # pragma message("Using arc4random system call")
@@ -360,3 +433,320 @@ int randombytes(void *buf, size_t n)
 # error "randombytes(...) is not supported on this platform"
 #endif
 }
+
+int randombytes_checked(void *buf, size_t n, dudero_ctx_t *check)
+{
+#if (defined(__linux__) || defined(__GNU__)) && !defined(__EMSCRIPTEN__) && (defined(USE_GLIBC) || defined(SYS_getrandom))
+	/* Fed right after each syscall */
+	return randombytes_linux_randombytes_getrandom(buf, n, check);
+#elif (defined(__linux__) || defined(GNU_KFREEBSD)) && !defined(__EMSCRIPTEN__) && !defined(SYS_getrandom)
+	return randombytes_linux_randombytes_urandom(buf, n, check);
+#else
+	/* The other sources fill whole buffers, so ask them one chunk at a time */
+	size_t offset = 0, chunk;
+	int ret;
+	while (n > 0) {
+		chunk = n <= RANDOMBYTES_CHECK_CHUNK ? n : RANDOMBYTES_CHECK_CHUNK;
+		ret = randombytes((char *)buf + offset, chunk);
+		if (ret != 0) return ret;
+		if (randombytes_feed(check, (char *)buf + offset, chunk)) return 1;
+		offset += chunk;
+		n -= chunk;
+	}
+	return 0;
+#endif
+}
+
+
+/*
+ * Instruction-level sources
+ *
+ * Each instruction returns 64 bits and a flag telling whether they are
+ * valid. It fails when the hardware generator is momentarily drained (RDSEED
+ * and RNDRRS do so readily under contention), so a failed step is retried
+ * after a pause that doubles each time, within a fixed budget. Past it the
+ * source is considered broken.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+# define RANDOMBYTES_HW_X86
+# include <cpuid.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+# define RANDOMBYTES_HW_ARM
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  ifndef HWCAP2_RNG
+#   define HWCAP2_RNG (1 << 16)
+#  endif
+# endif
+#endif
+
+/* Attempts per 64-bit word, and the longest pause between two, in spins */
+#define RANDOMBYTES_HW_TRIES 32
+#define RANDOMBYTES_HW_MAX_SPINS 1024
+
+int randombytes_hw_supported(randombytes_hw_source src)
+{
+#if defined(RANDOMBYTES_HW_X86)
+	unsigned int a, b, c, d;
+	switch (src) {
+	case RANDOMBYTES_HW_RDRAND:
+		return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_RDRND);
+	case RANDOMBYTES_HW_RDSEED:
+		return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_RDSEED);
+	default:
+		return 0;
+	}
+#elif defined(RANDOMBYTES_HW_ARM) && defined(__linux__)
+	switch (src) {
+	case RANDOMBYTES_HW_RNDR:
+	case RANDOMBYTES_HW_RNDRRS:
+		return (getauxval(AT_HWCAP2) & HWCAP2_RNG) != 0;
+	default:
+		return 0;
+	}
+#else
+	(void)src;
+	return 0;
+#endif
+}
+
+#if defined(RANDOMBYTES_HW_X86) || defined(RANDOMBYTES_HW_ARM)
+/* One step of src: 1 and *v on success, 0 if the instruction failed */
+static int randombytes_hw_step(randombytes_hw_source src, uint64_t *v)
+{
+	unsigned char ok;
+#if defined(RANDOMBYTES_HW_X86)
+	/* Carry set on success */
+	if (src == RANDOMBYTES_HW_RDSEED) {
+		__asm__ __volatile__("rdseed %0; setc %1" : "=r"(*v), "=qm"(ok) : : "cc");
+	} else {
+		__asm__ __volatile__("rdrand %0; setc %1" : "=r"(*v), "=qm"(ok) : : "cc");
+	}
+#else
+	/* Z clear on success; by encoding, so no -march flag is needed */
+	if (src == RANDOMBYTES_HW_RNDRRS) {
+		__asm__ __volatile__("mrs %0, s3_3_c2_c4_1; cset %w1, ne" : "=r"(*v), "=r"(ok) : : "cc");
+	} else {
+		__asm__ __volatile__("mrs %0, s3_3_c2_c4_0; cset %w1, ne" : "=r"(*v), "=r"(ok) : : "cc");
+	}
+#endif
+	return ok;
+}
+
+static void randombytes_hw_pause(unsigned spins)
+{
+	while (spins--) {
+#if defined(RANDOMBYTES_HW_X86)
+		__asm__ __volatile__("pause");
+#else
+		__asm__ __volatile__("yield");
+#endif
+	}
+}
+
+static int randombytes_hw_word(randombytes_hw_source src, uint64_t *v)
+{
+	unsigned spins = 1;
+	int i;
+	for (i = 0; i < RANDOMBYTES_HW_TRIES; i++) {
+		if (randombytes_hw_step(src, v)) return 0;
+		randombytes_hw_pause(spins);
+		if (spins < RANDOMBYTES_HW_MAX_SPINS) spins *= 2;
+	}
+	return -1;
+}
+#endif /* defined(RANDOMBYTES_HW_X86) || defined(RANDOMBYTES_HW_ARM) */
+
+int randombytes_hw(randombytes_hw_source src, void *buf, size_t n, struct dudero_ctx *check)
+{
+#if defined(RANDOMBYTES_HW_X86) || defined(RANDOMBYTES_HW_ARM)
+	unsigned char *out = (unsigned char *)buf;
+	size_t chunk, i;
+	uint64_t v;
+	if (!randombytes_hw_supported(src)) return -1;
+	while (n > 0) {
+		/* Fed a chunk at a time, right after it is produced */
+		chunk = n <= RANDOMBYTES_CHECK_CHUNK ? n : RANDOMBYTES_CHECK_CHUNK;
+		for (i = 0; i < chunk; i += 8) {
+			if (randombytes_hw_word(src, &v) != 0) return -1;
+			memcpy(out + i, &v, chunk - i < 8 ? chunk - i : 8);
+		}
+		if (randombytes_feed(check, out, chunk)) return 1;
+		out += chunk;
+		n -= chunk;
+	}
+	return 0;
+#else
+	(void)src; (void)buf; (void)n; (void)check;
+	return -1;
+#endif
+}
+
+
+/*
+ * Buffered reader
+ *
+ * The buffer starts with the reader state below, followed by the random
+ * bytes. On Linux it is an anonymous mapping marked MADV_WIPEONFORK: a
+ * forked child finds it zeroed, i.e. empty, and never hands out the bytes
+ * its parent already has. Elsewhere the state records the pid of the last
+ * refill and a different pid empties the buffer.
+ */
+#if defined(__linux__) && defined(MADV_WIPEONFORK)
+# define RANDOMBYTES_WIPEONFORK
+#elif defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+# define RANDOMBYTES_CHECK_PID
+#endif
+
+#define RANDOMBYTES_READER_DEFAULT_CAP (64 * 1024)
+
+struct randombytes_reader_state {
+	size_t pos, len;
+#if defined(RANDOMBYTES_CHECK_PID)
+	pid_t pid;
+#endif
+};
+
+/* Header size, keeping the bytes aligned */
+#define RANDOMBYTES_READER_HDR 64
+
+/* memset() that isn't optimized away right before free() */
+static void randombytes_wipe(void *p, size_t n)
+{
+	volatile unsigned char *v = (volatile unsigned char *)p;
+	while (n--) *v++ = 0;
+}
+
+static struct randombytes_reader_state *randombytes_reader_state(randombytes_reader *r)
+{
+	return (struct randombytes_reader_state *)r->mem;
+}
+
+/* Refills the whole buffer with a single call when the source allows it */
+static int randombytes_reader_fill(randombytes_reader *r, size_t *got)
+{
+	unsigned char *dst = (unsigned char *)r->mem + RANDOMBYTES_READER_HDR;
+	size_t offset, chunk;
+#if (defined(__linux__) || defined(__GNU__)) && !defined(__EMSCRIPTEN__) && (defined(USE_GLIBC) || defined(SYS_getrandom))
+	ssize_t ret;
+	do {
+		ret = getrandom(dst, r->cap, 0);
+	} while (ret == -1 && errno == EINTR);
+	if (ret < 0) return -1;
+	*got = (size_t)ret;
+#elif (defined(__linux__) || defined(GNU_KFREEBSD)) && !defined(__EMSCRIPTEN__) && !defined(SYS_getrandom)
+	ssize_t ret;
+	do {
+		ret = read(r->fd, dst, r->cap);
+	} while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+	if (ret <= 0) return -1;
+	*got = (size_t)ret;
+#else
+	if (randombytes(dst, r->cap) != 0) return -1;
+	*got = r->cap;
+#endif
+	/* Checked in the same chunks as by randombytes_checked() */
+	for (offset = 0; offset < *got; offset += chunk) {
+		chunk = *got - offset <= RANDOMBYTES_CHECK_CHUNK ? *got - offset : RANDOMBYTES_CHECK_CHUNK;
+		if (randombytes_feed(r->check, dst + offset, chunk)) return 1;
+	}
+	return 0;
+}
+
+int randombytes_reader_init(randombytes_reader *r, size_t cap, struct dudero_ctx *check)
+{
+	size_t size;
+	if (cap == 0) cap = RANDOMBYTES_READER_DEFAULT_CAP;
+	if (cap > SIZE_MAX - RANDOMBYTES_READER_HDR) return -1;
+	size = RANDOMBYTES_READER_HDR + cap;
+	r->cap = cap;
+	r->check = check;
+	r->fd = -1;
+#if defined(RANDOMBYTES_WIPEONFORK)
+	r->mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r->mem == MAP_FAILED) return -1;
+	if (madvise(r->mem, size, MADV_WIPEONFORK) != 0) {
+		/* Pre-4.14 kernel: without it, buffering isn't fork-safe */
+		munmap(r->mem, size);
+		return -1;
+	}
+#else
+	r->mem = calloc(1, size);
+	if (r->mem == NULL) return -1;
+#endif
+#if (defined(__linux__) || defined(GNU_KFREEBSD)) && !defined(__EMSCRIPTEN__) && !defined(SYS_getrandom)
+	/* Opened, and waited for entropy, once for the reader's lifetime */
+	r->fd = randombytes_linux_open_urandom();
+	if (r->fd == -1) {
+		randombytes_reader_close(r);
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+int randombytes_reader_read(randombytes_reader *r, void *buf, size_t n)
+{
+	struct randombytes_reader_state *st = randombytes_reader_state(r);
+	unsigned char *bytes = (unsigned char *)r->mem + RANDOMBYTES_READER_HDR;
+	unsigned char *out = (unsigned char *)buf;
+	size_t chunk, got;
+	int ret;
+#if defined(RANDOMBYTES_CHECK_PID)
+	if (st->pid != getpid()) {
+		memset(bytes, 0, st->len);
+		st->pos = st->len = 0;
+	}
+#endif
+	/* Large requests don't gain from the copy */
+	if (n >= r->cap) {
+#if (defined(__linux__) || defined(GNU_KFREEBSD)) && !defined(__EMSCRIPTEN__) && !defined(SYS_getrandom)
+		return randombytes_linux_read_urandom(r->fd, buf, n, r->check);
+#else
+		return randombytes_checked(buf, n, r->check);
+#endif
+	}
+	while (n > 0) {
+		if (st->pos == st->len) {
+			ret = randombytes_reader_fill(r, &got);
+			if (ret != 0) {
+				memset(bytes, 0, r->cap);
+				st->pos = st->len = 0;
+				return ret;
+			}
+			st->pos = 0;
+			st->len = got;
+#if defined(RANDOMBYTES_CHECK_PID)
+			st->pid = getpid();
+#endif
+		}
+		chunk = st->len - st->pos;
+		if (chunk > n) chunk = n;
+		memcpy(out, bytes + st->pos, chunk);
+		/* Served bytes must not linger around */
+		memset(bytes + st->pos, 0, chunk);
+		st->pos += chunk;
+		out += chunk;
+		n -= chunk;
+	}
+	return 0;
+}
+
+void randombytes_reader_close(randombytes_reader *r)
+{
+	if (r->mem != NULL) {
+		randombytes_wipe(r->mem, RANDOMBYTES_READER_HDR + r->cap);
+#if defined(RANDOMBYTES_WIPEONFORK)
+		munmap(r->mem, RANDOMBYTES_READER_HDR + r->cap);
+#else
+		free(r->mem);
+#endif
+		r->mem = NULL;
+	}
+#if defined(__linux__) || defined(GNU_KFREEBSD)
+	if (r->fd != -1) {
+		close(r->fd);
+		r->fd = -1;
+	}
+#endif
+}
@@ -18,6 +18,71 @@ extern "C" {
  */
 int randombytes(void *buf, size_t n);
 
+struct dudero_ctx;
+
+/*
+ * Same as randombytes(), also feeding the bytes to the dudero health check
+ * context `check` (see ../dudero.h) as they are produced, a few KiB at a
+ * time while they're still in cache, sparing a second pass over `buf`.
+ * `check` may be NULL. The verdict is left to the caller (dudero_ctx_finish).
+ *
+ * Returns 0 on success, -1 on error of the underlying source, and 1 if
+ * `check` rejected the data (it's in fail-fast mode and saw bad randomness,
+ * or got more than its length); `buf` is then only partially written.
+ */
+int randombytes_checked(void *buf, size_t n, struct dudero_ctx *check);
+
+/*
+ * Buffered reader: refills an internal buffer of `cap` bytes (0 for the
+ * default, 64 KiB) with one large read and serves many small requests from
+ * it, so a producer isn't bound by the syscall rate. On the /dev/urandom
+ * path the device is opened, and waited on for entropy, once per reader.
+ * If `check` isn't NULL, every refill is fed to it in 4 KiB pieces, as in
+ * randombytes_checked(); large reads (n >= cap) bypass the buffer and go
+ * to the source, the reader's descriptor on the /dev/urandom path.
+ *
+ * Served bytes are wiped from the buffer, and a forked child never gets
+ * bytes buffered by its parent. A reader isn't thread-safe; use one per
+ * thread.
+ */
+typedef struct randombytes_reader {
+	void *mem;    /* state followed by the buffered bytes */
+	size_t cap;
+	int fd;       /* persistent /dev/urandom descriptor, or -1 */
+	struct dudero_ctx *check;
+} randombytes_reader;
+
+/* Returns 0 on success, -1 on error */
+int randombytes_reader_init(randombytes_reader *r, size_t cap, struct dudero_ctx *check);
+/* Same return values as randombytes_checked() */
+int randombytes_reader_read(randombytes_reader *r, void *buf, size_t n);
+void randombytes_reader_close(randombytes_reader *r);
+
+/*
+ * Hardware sources, bypassing the kernel: the CPU's own generator, read 64
+ * bits per instruction into `buf`, no syscall. Whether that's faster than
+ * randombytes() depends on the CPU (and hypervisor): see the randombytes_*
+ * modes of ./bench. If `check` isn't NULL, the output is fed to it as in
+ * randombytes_checked(): this is the place to catch a generator reporting
+ * success with bad output, such as the microcode bugs making RDRAND return
+ * all ones. Failed instructions are retried with a bounded, exponential
+ * backoff.
+ */
+typedef enum {
+	RANDOMBYTES_HW_RDRAND, /* x86-64: output of the on-chip DRBG */
+	RANDOMBYTES_HW_RDSEED, /* x86-64: conditioned entropy, for seeding */
+	RANDOMBYTES_HW_RNDR,   /* AArch64 FEAT_RNG: output of the DRBG */
+	RANDOMBYTES_HW_RNDRRS  /* AArch64 FEAT_RNG: DRBG reseeded on each read */
+} randombytes_hw_source;
+
+/* 1 if `src` is compiled in and the running CPU has it, else 0 */
+int randombytes_hw_supported(randombytes_hw_source src);
+/*
+ * Same return values as randombytes_checked(); -1 also if `src` isn't
+ * supported or kept failing past the retry budget.
+ */
+int randombytes_hw(randombytes_hw_source src, void *buf, size_t n, struct dudero_ctx *check);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,360 @@
+// Throughput/latency benchmark: every API and backend over buffer sizes
+// from 16 B to 64 MiB. Prints one CSV (or JSON) record per measurement so
+// results can be tracked over time.
+//
+//   make bench && ./bench [--json] [--min-time-ms N] [--max-size BYTES] [--threads N]
+//                         [--baseline FILE [--max-slowdown PCT]]
+//
+// With --baseline, FILE is the CSV output of an earlier run (same machine,
+// same options): every record slower than its baseline by more than PCT
+// percent (default 10) is reported on stderr, and the exit status is 1
+// (2 on errors).
+// `make perf-baseline` and `make perf-check` wrap both steps.
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime, sysconf
+
+#include "dudero.h"
+#include "dudero_batch.h"
+#include "dudero_mt.h"
+#include "prng.h"
+#include "randombytes/randombytes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <x86intrin.h>
+# define HAVE_RDTSC 1
+#endif
+
+static struct {
+    int json;
+    uint64_t min_time_ns;
+    size_t max_size;
+    unsigned threads;
+    int records;
+    double max_slowdown; // percent
+    int regressions;
+} opt = {0, 200000000ull, (size_t)64 << 20, 0, 0, 10.0, 0};
+
+// records of the --baseline run
+#define MAX_BASELINE (1024)
+
+typedef struct {
+    char mode[48];
+    char backend[16];
+    size_t size;
+    double ns_per_op;
+} baseline_t;
+
+static baseline_t baseline[MAX_BASELINE];
+static size_t nbaseline;
+
+static int load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof line, f) != NULL && nbaseline < MAX_BASELINE) {
+        baseline_t *b = &baseline[nbaseline];
+        unsigned long long iters;
+        // the header doesn't parse, and is skipped like any other stray line
+        if (sscanf(line, "%47[^,],%15[^,],%zu,%llu,%lf", b->mode, b->backend, &b->size, &iters, &b->ns_per_op) == 5) {
+            nbaseline++;
+        }
+    }
+    fclose(f);
+    if (nbaseline == 0) {
+        fprintf(stderr, "%s: no records\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// ns/op of the baseline record, 0 if none
+static double baseline_ns(const char *mode, const char *backend, size_t size) {
+    for (size_t i=0; i<nbaseline; i++) {
+        const baseline_t *b = &baseline[i];
+        if (b->size == size && strcmp(b->mode, mode) == 0 && strcmp(b->backend, backend) == 0) {
+            return b->ns_per_op;
+        }
+    }
+    return 0.0;
+}
+
+static bool over_baseline(double ns_per_op, double base) {
+    return base > 0.0 && 100.0 * (ns_per_op / base - 1.0) > opt.max_slowdown;
+}
+
+// keeps the compiler from dropping the checks
+static volatile unsigned sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#if defined(HAVE_RDTSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// one benchmarked operation over buf[0..len)
+typedef void (*op_fn)(const uint8_t *buf, size_t len, dudero_backend_t backend);
+
+static void op_stream(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_set_backend(&ctx, backend);
+    for (size_t i=0; i<len; i++) {
+        dudero_ctx_add(&ctx, buf[i]);
+    }
+    sink += dudero_ctx_finish(&ctx);
+}
+
+static void op_ctx_buf(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_set_backend(&ctx, backend);
+    dudero_ctx_add_buf(&ctx, buf, len);
+    sink += dudero_ctx_finish(&ctx);
+}
+
+static void op_ctx_buf_all_tests(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_set_backend(&ctx, backend);
+    dudero_ctx_enable_tests(&ctx, DUDERO_TEST_ALL);
+    dudero_ctx_add_buf(&ctx, buf, len);
+    sink += dudero_ctx_finish(&ctx);
+}
+
+static void op_check_buffer(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)backend;
+    sink += dudero_check_buffer(buf, len);
+}
+
+static void op_check_buffer_mt(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)backend;
+    sink += dudero_check_buffer_mt(buf, len, opt.threads);
+}
+
+// len bytes as DUDERO_BATCH_LANES buffers of len / DUDERO_BATCH_LANES: one
+// dudero_check_buffers() call against a loop of dudero_check_buffer()
+static void op_check_buffers(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)backend;
+    const uint8_t *bufs[DUDERO_BATCH_LANES];
+    size_t lens[DUDERO_BATCH_LANES];
+    dudero_ret_t out[DUDERO_BATCH_LANES];
+    for (size_t j=0; j<DUDERO_BATCH_LANES; j++) {
+        bufs[j] = buf + j * (len / DUDERO_BATCH_LANES);
+        lens[j] = len / DUDERO_BATCH_LANES;
+    }
+    dudero_check_buffers(bufs, lens, DUDERO_BATCH_LANES, out);
+    for (size_t j=0; j<DUDERO_BATCH_LANES; j++) {
+        sink += out[j];
+    }
+}
+
+static void op_check_buffer_loop(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)backend;
+    for (size_t j=0; j<DUDERO_BATCH_LANES; j++) {
+        sink += dudero_check_buffer(buf + j * (len / DUDERO_BATCH_LANES), len / DUDERO_BATCH_LANES);
+    }
+}
+
+// Sources: len fresh bytes into scratch, checked as they're produced
+static uint8_t *scratch;
+static randombytes_hw_source hw_source;
+
+static void op_randombytes_checked(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)buf;
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_set_backend(&ctx, backend);
+    sink += randombytes_checked(scratch, len, &ctx);
+    sink += dudero_ctx_finish(&ctx);
+}
+
+static void op_randombytes_hw(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)buf;
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_set_backend(&ctx, backend);
+    sink += randombytes_hw(hw_source, scratch, len, &ctx);
+    sink += dudero_ctx_finish(&ctx);
+}
+
+static const char *hw_source_modes[] = {
+    [RANDOMBYTES_HW_RDRAND] = "randombytes_hw_rdrand",
+    [RANDOMBYTES_HW_RDSEED] = "randombytes_hw_rdseed",
+    [RANDOMBYTES_HW_RNDR] = "randombytes_hw_rndr",
+    [RANDOMBYTES_HW_RNDRRS] = "randombytes_hw_rndrrs",
+};
+
+// dudero_ctx_finish() alone, on a context already holding len bytes
+static dudero_ctx_t finish_ctx;
+
+static void op_finish(const uint8_t *buf, size_t len, dudero_backend_t backend) {
+    (void)buf; (void)len; (void)backend;
+    sink += dudero_ctx_finish(&finish_ctx);
+}
+
+static void report(const char *mode, const char *backend, size_t size, uint64_t iters,
+                   uint64_t ns, uint64_t cyc) {
+    double ns_per_op = (double)ns / (double)iters;
+    double mb_per_s = (size && ns) ? (double)size * (double)iters / ((double)ns / 1e9) / 1e6 : 0.0;
+    double cycles_per_op = (double)cyc / (double)iters;
+    double cycles_per_byte = size ? cycles_per_op / (double)size : 0.0;
+    if (opt.json) {
+        printf("%s{\"mode\":\"%s\",\"backend\":\"%s\",\"size\":%zu,\"iterations\":%llu,"
+               "\"ns_per_op\":%.1f,\"mb_per_s\":%.1f,\"cycles_per_op\":%.1f,\"cycles_per_byte\":%.3f}",
+               opt.records ? ",\n" : "[\n", mode, backend, size, (unsigned long long)iters,
+               ns_per_op, mb_per_s, cycles_per_op, cycles_per_byte);
+    } else {
+        if (!opt.records) {
+            printf("mode,backend,size,iterations,ns_per_op,mb_per_s,cycles_per_op,cycles_per_byte\n");
+        }
+        printf("%s,%s,%zu,%llu,%.1f,%.1f,%.1f,%.3f\n", mode, backend, size,
+               (unsigned long long)iters, ns_per_op, mb_per_s, cycles_per_op, cycles_per_byte);
+    }
+    opt.records++;
+    fflush(stdout);
+    double base = baseline_ns(mode, backend, size);
+    if (over_baseline(ns_per_op, base)) {
+        fprintf(stderr, "regression: %s,%s,%zu: %.1f ns/op, baseline %.1f (%+.1f%%)\n", mode, backend, size,
+                ns_per_op, base, 100.0 * (ns_per_op / base - 1.0));
+        opt.regressions++;
+    }
+}
+
+// doubles the iteration count until a run lasts at least min_time_ns
+static void measure(dudero_backend_t backend, op_fn op, const uint8_t *buf, size_t len,
+                    uint64_t *iters, uint64_t *ns, uint64_t *cyc) {
+    for (*iters=1;; *iters*=2) {
+        uint64_t t0 = now_ns(), c0 = cycles();
+        for (uint64_t i=0; i<*iters; i++) {
+            op(buf, len, backend);
+        }
+        *cyc = cycles() - c0;
+        *ns = now_ns() - t0;
+        if (*ns >= opt.min_time_ns || *iters >= (1ull << 40)) {
+            break;
+        }
+    }
+}
+
+// Against a baseline, a record that looks slower is measured up to twice
+// more and the best run kept, so a single hiccup of the machine isn't
+// reported as a regression.
+#define BASELINE_RETRIES (2)
+
+static void run(const char *mode, dudero_backend_t backend, op_fn op, const uint8_t *buf, size_t len) {
+    uint64_t iters, ns, cyc;
+    measure(backend, op, buf, len, &iters, &ns, &cyc);
+    double base = baseline_ns(mode, dudero_backend_name(backend), len);
+    for (int retry=0; retry<BASELINE_RETRIES && over_baseline((double)ns / (double)iters, base); retry++) {
+        uint64_t iters2, ns2, cyc2;
+        measure(backend, op, buf, len, &iters2, &ns2, &cyc2);
+        if ((double)ns2 / (double)iters2 < (double)ns / (double)iters) {
+            iters = iters2;
+            ns = ns2;
+            cyc = cyc2;
+        }
+    }
+    report(mode, dudero_backend_name(backend), len, iters, ns, cyc);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--json] [--min-time-ms N] [--max-size BYTES] [--threads N]\n"
+                    "          [--baseline FILE [--max-slowdown PCT]]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            opt.json = 1;
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i+1 < argc) {
+            opt.min_time_ns = strtoull(argv[++i], NULL, 0) * 1000000ull;
+        } else if (strcmp(argv[i], "--max-size") == 0 && i+1 < argc) {
+            opt.max_size = (size_t)strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            opt.threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i+1 < argc) {
+            if (load_baseline(argv[++i]) != 0) {
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--max-slowdown") == 0 && i+1 < argc) {
+            opt.max_slowdown = strtod(argv[++i], NULL);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opt.threads = (n > 0) ? (unsigned)n : 1;
+    }
+
+    const size_t bufsize = opt.max_size > 16 ? opt.max_size : 16;
+    uint8_t *buf = malloc(bufsize);
+    scratch = malloc(bufsize);
+    if (buf == NULL || scratch == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    prng_t prng;
+    prng_seed(&prng, 1);
+    prng_fill(&prng, buf, bufsize);
+
+    for (size_t size=16; size<=opt.max_size; size*=4) {
+        run("check_buffer", dudero_backend_best(), op_check_buffer, buf, size);
+        for (int b=0; b<DUDERO_BACKEND_COUNT; b++) {
+            if (dudero_backend_supported((dudero_backend_t)b)) {
+                run("ctx_add_buf", (dudero_backend_t)b, op_ctx_buf, buf, size);
+            }
+        }
+        run("ctx_add_buf_all_tests", DUDERO_BACKEND_SCALAR, op_ctx_buf_all_tests, buf, size);
+        run("ctx_add", DUDERO_BACKEND_SCALAR, op_stream, buf, size);
+        if (size >= 16*DUDERO_BATCH_LANES && size <= DUDERO_BATCH_MAX_LEN*DUDERO_BATCH_LANES) {
+            run("check_buffers_x16", dudero_backend_best(), op_check_buffers, buf, size);
+            run("check_buffer_loop_x16", dudero_backend_best(), op_check_buffer_loop, buf, size);
+        }
+        if (size >= ((size_t)1 << 20)) {
+            run("check_buffer_mt", dudero_backend_best(), op_check_buffer_mt, buf, size);
+        }
+        if (size >= 4096 && size <= ((size_t)1 << 20)) {
+            run("randombytes_checked", dudero_backend_best(), op_randombytes_checked, buf, size);
+            for (int src=RANDOMBYTES_HW_RDRAND; src<=RANDOMBYTES_HW_RNDRRS; src++) {
+                if (randombytes_hw_supported((randombytes_hw_source)src)) {
+                    hw_source = (randombytes_hw_source)src;
+                    run(hw_source_modes[src], dudero_backend_best(), op_randombytes_hw, buf, size);
+                }
+            }
+        }
+    }
+
+    dudero_ctx_init(&finish_ctx);
+    dudero_ctx_add_buf(&finish_ctx, buf, 4096);
+    run("ctx_finish", DUDERO_BACKEND_SCALAR, op_finish, buf, 0);
+
+    if (opt.json && opt.records) {
+        printf("\n]\n");
+    }
+    free(scratch);
+    free(buf);
+    if (opt.regressions) {
+        fprintf(stderr, "%d records over the baseline by more than %.1f%%\n", opt.regressions, opt.max_slowdown);
+        return 1;
+    }
+    return 0;
+}
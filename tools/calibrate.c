@@ -0,0 +1,243 @@
+// Monte-Carlo calibration of the frequency test: false positive and miss
+// rates against every threshold of the alpha table, per buffer size.
+//
+//   make calibrate && ./calibrate [--sizes 16,64,...] [--trials N] [--threads N]
+//                                 [--seed S] [--stuck-every N] [--alpha K]
+//                                 [--max-fp RATE] [--max-miss RATE]
+//
+// Each trial checks one buffer of xoshiro output ("good") and the same
+// buffer with bit 4 cleared in every stuck-every'th byte ("bad", a stuck
+// data line). Trial i is seeded from (seed, i) alone, so results don't
+// depend on the number of threads. Prints one CSV record per size and
+// threshold:
+//
+//   size,alpha_log10,threshold,fp_rate,miss_rate
+//
+// alpha_log10 0 is DUDERO_THRES_Q16_DEFAULT. With --max-fp or --max-miss,
+// exits with 1 if a size goes over the bound at the --alpha threshold
+// (default: DUDERO_THRES_Q16_DEFAULT), so it can gate CI.
+
+#define _POSIX_C_SOURCE 200809L // sysconf
+
+#include "dudero.h"
+#include "prng.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_SIZES (32)
+
+static struct {
+    size_t sizes[MAX_SIZES];
+    size_t nsizes;
+    uint64_t trials;
+    unsigned threads;
+    uint64_t seed;
+    size_t stuck_every;
+    unsigned alpha;
+    double max_fp, max_miss; // negative: no bound
+} opt = {{16, 64, 256, 512, 4096}, 5, 100000, 0, 1, 2, 0, -1.0, -1.0};
+
+typedef struct {
+    size_t size;
+    uint64_t first, last; // trials [first, last)
+    uint32_t *good, *bad; // statistic of each trial
+} job_t;
+
+// cum / expected in Q16.16, rounded up: stat > thres_q16 exactly when
+// dudero_ctx_finish() fails at thres_q16 (see dudero_fixed_verdict()).
+// Same identity as dudero_ctx_peek().
+static uint32_t statistic(const dudero_ctx_t *ctx) {
+    uint64_t samples = ctx->hist_samples;
+    uint64_t expected = samples / 16;
+    uint64_t cum = ctx->hist_sumsq + 16*expected*expected - 2*expected*samples;
+    if (cum >= ((uint64_t)1 << 47)) {
+        return UINT32_MAX;
+    }
+    uint64_t stat = ((cum << 16) + expected - 1) / expected;
+    return (stat > UINT32_MAX) ? UINT32_MAX : (uint32_t)stat;
+}
+
+static uint32_t trial(const uint8_t *buf, size_t len) {
+    dudero_ctx_t ctx;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_add_buf(&ctx, buf, len);
+    return statistic(&ctx);
+}
+
+static void *worker_main(void *arg) {
+    job_t *job = arg;
+    uint8_t *buf = malloc(job->size);
+    if (buf == NULL) {
+        return arg;
+    }
+    for (uint64_t i=job->first; i<job->last; i++) {
+        prng_t prng;
+        prng_seed(&prng, opt.seed ^ (i * 0xD1B54A32D192ED03ull));
+        prng_fill(&prng, buf, job->size);
+        job->good[i] = trial(buf, job->size);
+        for (size_t j=0; j<job->size; j+=opt.stuck_every) {
+            buf[j] &= 0xEF;
+        }
+        job->bad[i] = trial(buf, job->size);
+    }
+    free(buf);
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// number of sorted[0..n) above thres
+static uint64_t above(const uint32_t *sorted, uint64_t n, uint32_t thres) {
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (sorted[mid] > thres) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return n - lo;
+}
+
+static uint32_t threshold(unsigned alpha_log10) {
+    return alpha_log10 ? dudero_threshold_q16(alpha_log10) : DUDERO_THRES_Q16_DEFAULT;
+}
+
+// Runs all trials for one size, prints its curve. 0 within bounds, 1 over,
+// 2 on errors.
+static int calibrate(size_t size) {
+    uint64_t n = opt.trials;
+    uint32_t *good = malloc(n * sizeof *good), *bad = malloc(n * sizeof *bad);
+    job_t *jobs = calloc(opt.threads, sizeof *jobs);
+    pthread_t *tids = calloc(opt.threads, sizeof *tids);
+    int ret = 0;
+    if (good == NULL || bad == NULL || jobs == NULL || tids == NULL) {
+        fprintf(stderr, "out of memory\n");
+        ret = 2;
+        goto out;
+    }
+    unsigned started = 0;
+    for (unsigned t=0; t<opt.threads; t++) {
+        jobs[t] = (job_t){size, n * t / opt.threads, n * (t+1) / opt.threads, good, bad};
+    }
+    while (started + 1 < opt.threads && pthread_create(&tids[started], NULL, worker_main, &jobs[started + 1]) == 0) {
+        started++;
+    }
+    // whatever couldn't get a thread runs here
+    for (unsigned t=started+1; t<opt.threads; t++) {
+        ret |= worker_main(&jobs[t]) != NULL;
+    }
+    ret |= worker_main(&jobs[0]) != NULL;
+    for (unsigned t=0; t<started; t++) {
+        void *r;
+        pthread_join(tids[t], &r);
+        ret |= r != NULL;
+    }
+    if (ret) {
+        fprintf(stderr, "out of memory\n");
+        ret = 2;
+        goto out;
+    }
+
+    qsort(good, n, sizeof *good, cmp_u32);
+    qsort(bad, n, sizeof *bad, cmp_u32);
+    for (unsigned k=0; k<=DUDERO_ALPHA_LOG10_MAX; k++) {
+        uint32_t thres = threshold(k);
+        printf("%zu,%u,%.2f,%.3g,%.3g\n", size, k, thres / 65536.0,
+               (double)above(good, n, thres) / (double)n,
+               (double)(n - above(bad, n, thres)) / (double)n);
+    }
+
+    uint32_t thres = threshold(opt.alpha);
+    double fp = (double)above(good, n, thres) / (double)n;
+    double miss = (double)(n - above(bad, n, thres)) / (double)n;
+    if (opt.max_fp >= 0 && fp > opt.max_fp) {
+        fprintf(stderr, "size %zu: false positive rate %.3g over %.3g\n", size, fp, opt.max_fp);
+        ret = 1;
+    }
+    if (opt.max_miss >= 0 && miss > opt.max_miss) {
+        fprintf(stderr, "size %zu: miss rate %.3g over %.3g\n", size, miss, opt.max_miss);
+        ret = 1;
+    }
+out:
+    free(tids);
+    free(jobs);
+    free(bad);
+    free(good);
+    return ret;
+}
+
+static int parse_sizes(const char *s) {
+    opt.nsizes = 0;
+    while (*s) {
+        char *end;
+        unsigned long long v = strtoull(s, &end, 0);
+        if (end == s || v < 16 || v > DUDERO_MAX_LEN || opt.nsizes == MAX_SIZES) {
+            return -1;
+        }
+        opt.sizes[opt.nsizes++] = (size_t)v;
+        s = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return opt.nsizes ? 0 : -1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--sizes 16,64,...] [--trials N] [--threads N] [--seed S] [--stuck-every N]\n"
+                    "          [--alpha K] [--max-fp RATE] [--max-miss RATE]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i+1 < argc) {
+            if (parse_sizes(argv[++i]) != 0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--trials") == 0 && i+1 < argc) {
+            opt.trials = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            opt.threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            opt.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--stuck-every") == 0 && i+1 < argc) {
+            opt.stuck_every = (size_t)strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--alpha") == 0 && i+1 < argc) {
+            opt.alpha = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--max-fp") == 0 && i+1 < argc) {
+            opt.max_fp = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--max-miss") == 0 && i+1 < argc) {
+            opt.max_miss = strtod(argv[++i], NULL);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.trials == 0 || opt.stuck_every == 0 || opt.alpha > DUDERO_ALPHA_LOG10_MAX) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opt.threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opt.threads = (n > 0) ? (unsigned)n : 1;
+    }
+
+    int status = 0;
+    printf("size,alpha_log10,threshold,fp_rate,miss_rate\n");
+    for (size_t i=0; i<opt.nsizes; i++) {
+        int ret = calibrate(opt.sizes[i]);
+        status = (ret > status) ? ret : status;
+        fflush(stdout);
+    }
+    return status;
+}
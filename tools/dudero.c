@@ -0,0 +1,389 @@
+// Command line checker for captured RNG output: files, or stdin.
+//
+//   make dudero && ./dudero [--block BYTES] [--threads N] [--all-tests]
+//                           [--bytes] [--pairs] [--alpha K] [--verbose]
+//                           [FILE...]
+//
+// Each input is cut into blocks (default: DUDERO_MAX_LEN, i.e. whole files
+// up to 1 GiB) and every block gets its own verdict. Bad blocks are
+// printed to stdout, a summary with the throughput to stderr. Exits with 0
+// if all blocks passed, 1 if any was bad, 2 on errors.
+//
+// --all-tests enables DUDERO_TEST_ALL, the tests that live in the context;
+// --bytes and --pairs add the byte histogram (dudero_bytes.h) and the
+// nibble transitions (dudero_pairs.h), each with its counters per context.
+//
+// Regular files are mmapped and read sequentially; pipes go through large
+// aligned reads. Either way the data is checked in rounds of up to
+// threads * SHARD bytes, one shard per thread. Blocks larger than a shard
+// are split, checked in pieces and merged (see dudero_ctx_merge()), so the
+// sequential tests restart at each piece; the frequency test is exact.
+
+#define _DEFAULT_SOURCE // madvise
+#define _POSIX_C_SOURCE 200809L
+
+#include "dudero.h"
+#include "dudero_bytes.h"
+#include "dudero_pairs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// bytes per thread and round, before rounding down to whole blocks
+#define SHARD ((size_t)16 << 20)
+#define ALIGN (4096)
+
+static struct {
+    size_t block;
+    unsigned threads;
+    unsigned tests; // DUDERO_TEST_*, BYTES and PAIRS included
+    unsigned alpha;
+    int verbose;
+} opt = {DUDERO_MAX_LEN, 0, DUDERO_TEST_FREQ, 0, 0};
+
+static const char *test_names[] = {"freq", "rct", "apt", "runs", "bits", "bytes", "pairs"};
+
+// One shard of a round: whole blocks, or (blocks > SHARD) part of one.
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    uint8_t *ret;    // whole blocks: dudero_ret_t of each
+    uint8_t *failed; // and the DUDERO_TEST_* that failed
+    dudero_ctx_t ctx; // part of a block: what the piece added
+    dudero_bytes_t bytes; // and its optional counters
+    dudero_pairs_t pairs;
+} piece_t;
+
+typedef struct {
+    piece_t *pieces;
+    size_t n;
+    size_t next; // next piece to take, atomic
+} round_t;
+
+// state of one input across rounds
+typedef struct {
+    const char *name;
+    uint64_t offset;  // bytes handed to rounds so far
+    uint64_t blocks, bad, too_short;
+    dudero_ctx_t acc; // block in progress, blocks > SHARD only
+    dudero_bytes_t acc_bytes;
+    dudero_pairs_t acc_pairs;
+    int status;       // exit code so far
+} input_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// bytes and pairs are only attached if their test is enabled
+static void ctx_setup(dudero_ctx_t *ctx, dudero_bytes_t *bytes, dudero_pairs_t *pairs) {
+    dudero_ctx_init(ctx);
+    dudero_ctx_enable_tests(ctx, opt.tests & DUDERO_TEST_ALL);
+    if (opt.tests & DUDERO_TEST_BYTES) {
+        dudero_ctx_attach_bytes(ctx, bytes);
+    }
+    if (opt.tests & DUDERO_TEST_PAIRS) {
+        dudero_ctx_attach_pairs(ctx, pairs);
+    }
+    if (opt.alpha) {
+        dudero_ctx_set_alpha(ctx, opt.alpha);
+    }
+}
+
+static bool whole_blocks(void) {
+    return opt.block <= SHARD;
+}
+
+// shard length, a multiple of the block length if blocks fit in a shard
+static size_t shard_len(void) {
+    return whole_blocks() ? SHARD / opt.block * opt.block : SHARD;
+}
+
+static void run_piece(piece_t *p) {
+    if (!whole_blocks()) {
+        ctx_setup(&p->ctx, &p->bytes, &p->pairs);
+        dudero_ctx_add_buf(&p->ctx, p->buf, p->len);
+        return;
+    }
+    for (size_t off=0, i=0; off<p->len; off+=opt.block, i++) {
+        size_t len = (p->len - off < opt.block) ? p->len - off : opt.block;
+        dudero_ctx_t ctx;
+        dudero_bytes_t bytes;
+        dudero_pairs_t pairs;
+        unsigned failed;
+        ctx_setup(&ctx, &bytes, &pairs);
+        dudero_ctx_add_buf(&ctx, p->buf + off, len);
+        p->ret[i] = (uint8_t)dudero_ctx_finish_tests(&ctx, &failed);
+        p->failed[i] = (uint8_t)failed;
+    }
+}
+
+static void *worker_main(void *arg) {
+    round_t *r = arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED)) < r->n) {
+        run_piece(&r->pieces[i]);
+    }
+    return NULL;
+}
+
+static void report(input_t *in, uint64_t offset, dudero_ret_t ret, unsigned failed) {
+    uint64_t n = in->blocks++;
+    if (ret == DUDERO_RET_TOO_SHORT) {
+        in->too_short++;
+        return;
+    }
+    if (ret == DUDERO_RET_OK && !opt.verbose) {
+        return;
+    }
+    printf("%s: block %llu (offset %llu): %s", in->name, (unsigned long long)n,
+           (unsigned long long)offset, (ret == DUDERO_RET_OK) ? "ok" : "bad randomness");
+    for (size_t t=0; t<sizeof test_names / sizeof test_names[0]; t++) {
+        if (failed & (1u << t)) {
+            printf(" %s", test_names[t]);
+        }
+    }
+    printf("\n");
+    if (ret != DUDERO_RET_OK) {
+        in->bad++;
+        in->status = 1;
+    }
+}
+
+// Verdict on the large block in progress, which ends at `end`.
+static void finish_block(input_t *in, uint64_t end) {
+    unsigned failed;
+    dudero_ret_t ret = dudero_ctx_finish_tests(&in->acc, &failed);
+    report(in, (end - 1) / opt.block * opt.block, ret, failed);
+    ctx_setup(&in->acc, &in->acc_bytes, &in->acc_pairs);
+}
+
+// Checks buf[0..len), the next len bytes of the input.
+static int check_round(input_t *in, const uint8_t *buf, size_t len) {
+    const size_t shard = shard_len();
+    const size_t per_piece = whole_blocks() ? shard / opt.block : 0;
+    size_t cap = 2*(len / shard) + 2;
+    piece_t *pieces = calloc(cap, sizeof *pieces);
+    uint8_t *verdicts = per_piece ? malloc(2 * per_piece * cap) : NULL;
+    if (pieces == NULL || (per_piece && verdicts == NULL)) {
+        free(pieces);
+        free(verdicts);
+        fprintf(stderr, "%s: out of memory\n", in->name);
+        return 2;
+    }
+
+    // cut at shard and, for large blocks, block boundaries
+    round_t r = {pieces, 0, 0};
+    for (size_t pos=0; pos<len; ) {
+        size_t end = (len - pos < shard) ? len : pos + shard;
+        if (!whole_blocks()) {
+            uint64_t in_block = (in->offset + pos) % opt.block;
+            if (end - pos > opt.block - in_block) {
+                end = pos + (size_t)(opt.block - in_block);
+            }
+        }
+        piece_t *p = &pieces[r.n];
+        p->buf = buf + pos;
+        p->len = end - pos;
+        p->ret = verdicts ? verdicts + 2*per_piece*r.n : NULL;
+        p->failed = verdicts ? p->ret + per_piece : NULL;
+        r.n++;
+        pos = end;
+    }
+
+    unsigned nthreads = (r.n < opt.threads) ? (unsigned)r.n : opt.threads;
+    pthread_t tids[nthreads ? nthreads : 1];
+    unsigned started = 0;
+    while (started + 1 < nthreads && pthread_create(&tids[started], NULL, worker_main, &r) == 0) {
+        started++;
+    }
+    worker_main(&r);
+    for (unsigned t=0; t<started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    // verdicts, in input order
+    uint64_t offset = in->offset;
+    for (size_t i=0; i<r.n; i++) {
+        piece_t *p = &pieces[i];
+        if (whole_blocks()) {
+            for (size_t b=0; b*opt.block < p->len; b++) {
+                report(in, offset + b*opt.block, (dudero_ret_t)p->ret[b], p->failed[b]);
+            }
+        } else {
+            dudero_ctx_merge(&in->acc, &p->ctx);
+            if ((offset + p->len) % opt.block == 0) {
+                finish_block(in, offset + p->len);
+            }
+        }
+        offset += p->len;
+    }
+    in->offset = offset;
+    free(verdicts);
+    free(pieces);
+    return 0;
+}
+
+// a round per opt.threads shards; pipes are slower than that, so their
+// buffer is capped at STREAM_SHARDS
+#define STREAM_SHARDS (8)
+
+static size_t round_len(unsigned shards) {
+    return (size_t)shards * shard_len();
+}
+
+static int check_mapped(input_t *in, int fd, size_t size) {
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    const size_t step = round_len(opt.threads);
+    int ret = 0;
+    for (size_t off=0; off<size && ret == 0; off+=step) {
+        size_t len = (size - off < step) ? size - off : step;
+        ret = check_round(in, map + off, len);
+        // done with these pages, keep the resident set small
+        madvise(map + off, len, MADV_DONTNEED);
+    }
+    munmap(map, size);
+    return ret;
+}
+
+static int check_stream(input_t *in, int fd) {
+    const size_t step = round_len((opt.threads < STREAM_SHARDS) ? opt.threads : STREAM_SHARDS);
+    void *mem;
+    if (posix_memalign(&mem, ALIGN, step) != 0) {
+        fprintf(stderr, "%s: out of memory\n", in->name);
+        return 2;
+    }
+    uint8_t *buf = mem;
+    bool eof = false;
+    int ret = 0;
+    while (!eof && ret == 0) {
+        size_t len = 0;
+        while (len < step) {
+            ssize_t n = read(fd, buf + len, step - len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                fprintf(stderr, "%s: %s\n", in->name, strerror(errno));
+                free(buf);
+                return 2;
+            }
+            if (n == 0) {
+                eof = true;
+                break;
+            }
+            len += (size_t)n;
+        }
+        if (len > 0) {
+            ret = check_round(in, buf, len);
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+static int check_input(const char *name, uint64_t *total) {
+    input_t in;
+    memset(&in, 0, sizeof in);
+    in.name = name;
+    ctx_setup(&in.acc, &in.acc_bytes, &in.acc_pairs);
+    int fd = STDIN_FILENO;
+    if (strcmp(name, "-") != 0 && (fd = open(name, O_RDONLY)) < 0) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return 2;
+    }
+    uint64_t start = now_ns();
+    struct stat st;
+    int ret = -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (uint64_t)st.st_size <= SIZE_MAX) {
+        ret = check_mapped(&in, fd, (size_t)st.st_size);
+    }
+    if (ret < 0) {
+        // not a regular file, or it couldn't be mapped
+        ret = check_stream(&in, fd);
+    }
+    if (ret == 0 && in.acc.hist_samples) {
+        // the input ended inside a large block
+        finish_block(&in, in.offset);
+    }
+    double secs = (double)(now_ns() - start) / 1e9;
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    double mib = (double)in.offset / (1 << 20);
+    fprintf(stderr, "%s: %llu blocks, %llu bad, %llu too short; %.1f MiB in %.3f s, %.1f MiB/s\n",
+            name, (unsigned long long)in.blocks, (unsigned long long)in.bad,
+            (unsigned long long)in.too_short, mib, secs, secs > 0 ? mib / secs : 0.0);
+    *total += in.offset;
+    return ret ? ret : in.status;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--block BYTES] [--threads N] [--all-tests] [--bytes] [--pairs]\n"
+                    "       [--alpha K] [--verbose] [FILE...]\n"
+                    "checks each FILE (or stdin, also as -) block by block; BYTES in [16, %u]\n",
+            argv0, (unsigned)DUDERO_MAX_LEN);
+}
+
+int main(int argc, char **argv) {
+    int i;
+    for (i=1; i<argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--block") == 0 && i+1 < argc) {
+            opt.block = (size_t)strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            opt.threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--all-tests") == 0) {
+            opt.tests |= DUDERO_TEST_ALL;
+        } else if (strcmp(argv[i], "--bytes") == 0) {
+            opt.tests |= DUDERO_TEST_BYTES;
+        } else if (strcmp(argv[i], "--pairs") == 0) {
+            opt.tests |= DUDERO_TEST_PAIRS;
+        } else if (strcmp(argv[i], "--alpha") == 0 && i+1 < argc) {
+            opt.alpha = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            opt.verbose = 1;
+        } else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.block < 16 || opt.block > DUDERO_MAX_LEN || opt.alpha > DUDERO_ALPHA_LOG10_MAX) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opt.threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        opt.threads = (n > 0) ? (unsigned)n : 1;
+    }
+
+    uint64_t total = 0, start = now_ns();
+    int status = 0;
+    for (int j=i; j<argc || (j == i && i == argc); j++) {
+        int ret = check_input((j < argc) ? argv[j] : "-", &total);
+        status = (ret > status) ? ret : status;
+    }
+    if (argc - i > 1) {
+        double secs = (double)(now_ns() - start) / 1e9;
+        double mib = (double)total / (1 << 20);
+        fprintf(stderr, "total: %.1f MiB in %.3f s, %.1f MiB/s\n", mib, secs, secs > 0 ? mib / secs : 0.0);
+    }
+    return status;
+}
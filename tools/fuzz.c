@@ -0,0 +1,240 @@
+// Differential fuzz target: every backend and every API computing the
+// nibble histogram (buffer, byte at a time, stream, merge, fail-fast,
+// batch, window, snapshot, threads, fixed-length checker) must agree with
+// the scalar context on arbitrary inputs. Any disagreement aborts.
+//
+//   make fuzz && ./fuzz [--iterations N] [--seed S] [FILE...]
+//   make fuzz-libfuzzer && ./fuzz-libfuzzer corpus/   (clang)
+//
+// The standalone driver replays the given files, or else runs N generated
+// inputs: random, biased and constant bytes, from empty to past the flush
+// points of the SIMD counters. Input layout: byte 0 selects tiling (bit 7:
+// repeat the payload up to TILE_LEN bytes, past where the 8-bit counters
+// of every kernel are flushed), byte 1 the merge split and window length,
+// the rest is the payload.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "dudero.h"
+#include "dudero_batch.h"
+#include "dudero_bytes.h"
+#include "dudero_fixed.h"
+#include "dudero_mt.h"
+#include "dudero_pairs.h"
+#include "prng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE_LEN (2*127*64 + 77)
+
+#define FUZZ_ASSERT(cond)                                                            \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: %s fails on %zu bytes\n", __FILE__, __LINE__, #cond, len); \
+            abort();                                                                 \
+        }                                                                            \
+    } while (0)
+
+DUDERO_DEFINE_CHECKER(check_32, 32, DUDERO_THRES_Q16_DEFAULT)
+
+static uint8_t tiled[TILE_LEN];
+static uint8_t ring[16 + 255];
+
+static void check_input(const uint8_t *buf, size_t len, unsigned param) {
+    dudero_ctx_t ref, ctx;
+    unsigned failed;
+
+    dudero_ctx_init(&ref);
+    dudero_ctx_set_backend(&ref, DUDERO_BACKEND_SCALAR);
+    FUZZ_ASSERT(dudero_ctx_add_buf(&ref, buf, len) == DUDERO_RET_OK);
+    const dudero_ret_t verdict = dudero_ctx_finish(&ref);
+    FUZZ_ASSERT((verdict == DUDERO_RET_TOO_SHORT) == (len < 16));
+    FUZZ_ASSERT(dudero_check_buffer(buf, len) == verdict);
+    FUZZ_ASSERT(dudero_ctx_peek(&ref) == verdict);
+
+    for (int b=0; b<DUDERO_BACKEND_COUNT; b++) {
+        dudero_ctx_init(&ctx);
+        if (dudero_ctx_set_backend(&ctx, (dudero_backend_t)b) != DUDERO_RET_OK) {
+            continue;
+        }
+        dudero_ctx_add_buf(&ctx, buf, len);
+        FUZZ_ASSERT(memcmp(ctx.hist, ref.hist, sizeof ref.hist) == 0);
+        FUZZ_ASSERT(ctx.hist_sumsq == ref.hist_sumsq && ctx.hist_samples == ref.hist_samples);
+        FUZZ_ASSERT(dudero_ctx_finish(&ctx) == verdict);
+    }
+
+    // byte at a time and the legacy stream, with every optional test:
+    // same verdicts, test by test
+    dudero_bytes_t bytes, bytes2;
+    dudero_pairs_t pairs, pairs2;
+    unsigned failed_all;
+    dudero_ctx_init(&ctx);
+    dudero_ctx_enable_tests(&ctx, DUDERO_TEST_ALL);
+    dudero_ctx_attach_bytes(&ctx, &bytes);
+    dudero_ctx_attach_pairs(&ctx, &pairs);
+    dudero_ctx_add_buf(&ctx, buf, len);
+    const dudero_ret_t verdict_all = dudero_ctx_finish_tests(&ctx, &failed_all);
+    FUZZ_ASSERT((verdict_all == DUDERO_RET_TOO_SHORT) == (verdict == DUDERO_RET_TOO_SHORT));
+    FUZZ_ASSERT((failed_all & DUDERO_TEST_FREQ) == (verdict == DUDERO_RET_BAD_RANDOMNESS ? DUDERO_TEST_FREQ : 0));
+    dudero_ctx_init(&ctx);
+    dudero_ctx_enable_tests(&ctx, DUDERO_TEST_ALL);
+    dudero_ctx_attach_bytes(&ctx, &bytes2);
+    dudero_ctx_attach_pairs(&ctx, &pairs2);
+    for (size_t i=0; i<len; i++) {
+        dudero_ctx_add(&ctx, buf[i]);
+    }
+    FUZZ_ASSERT(memcmp(ctx.hist, ref.hist, sizeof ref.hist) == 0 && ctx.hist_sumsq == ref.hist_sumsq);
+    FUZZ_ASSERT(memcmp(bytes.bins, bytes2.bins, sizeof bytes.bins) == 0);
+    FUZZ_ASSERT(memcmp(pairs.cells, pairs2.cells, sizeof pairs.cells) == 0);
+    FUZZ_ASSERT(dudero_ctx_finish_tests(&ctx, &failed) == verdict_all && failed == failed_all);
+    dudero_stream_init();
+    dudero_stream_add_buf(buf, len / 2);
+    for (size_t i=len/2; i<len; i++) {
+        dudero_stream_add(buf[i]);
+    }
+    FUZZ_ASSERT(dudero_stream_finish() == verdict && dudero_stream_peek() == verdict);
+
+    // two halves merged, in either order
+    const size_t split = len * (param & 0xFF) / 256;
+    dudero_ctx_t lo, hi;
+    dudero_ctx_init(&lo);
+    dudero_ctx_init(&hi);
+    dudero_ctx_add_buf(&lo, buf, split);
+    dudero_ctx_add_buf(&hi, buf + split, len - split);
+    ctx = hi;
+    FUZZ_ASSERT(dudero_ctx_merge(&hi, &lo) == DUDERO_RET_OK && dudero_ctx_merge(&lo, &ctx) == DUDERO_RET_OK);
+    FUZZ_ASSERT(memcmp(lo.hist, ref.hist, sizeof ref.hist) == 0 && memcmp(hi.hist, ref.hist, sizeof ref.hist) == 0);
+    FUZZ_ASSERT(lo.hist_sumsq == ref.hist_sumsq && dudero_ctx_finish(&lo) == verdict);
+
+    // fail-fast never rejects what would pass, and agrees when it doesn't stop
+    if (len >= 16) {
+        dudero_ctx_init(&ctx);
+        dudero_ctx_set_fail_fast(&ctx, len);
+        dudero_ret_t ret = dudero_ctx_add_buf(&ctx, buf, len);
+        FUZZ_ASSERT(ret == DUDERO_RET_OK || (ret == DUDERO_RET_BAD_RANDOMNESS && verdict == ret));
+        FUZZ_ASSERT(ret != DUDERO_RET_OK || dudero_ctx_finish(&ctx) == verdict);
+    }
+
+    // batch of slices against one by one
+    const uint8_t *bufs[2*DUDERO_BATCH_LANES + 1];
+    size_t lens[2*DUDERO_BATCH_LANES + 1];
+    dudero_ret_t out[2*DUDERO_BATCH_LANES + 1];
+    size_t k = 0;
+    for (size_t off=0, step=1 + (param & 0x3F); off<len && k<2*DUDERO_BATCH_LANES + 1; off+=step, step=2*step+3) {
+        bufs[k] = buf + off;
+        lens[k++] = (len - off < step) ? len - off : step;
+    }
+    dudero_check_buffers(bufs, lens, k, out);
+    for (size_t i=0; i<k; i++) {
+        FUZZ_ASSERT(out[i] == dudero_check_buffer(bufs[i], lens[i]));
+    }
+
+    // the window ends on the last wlen bytes
+    const size_t wlen = 16 + (param & 0xFF);
+    dudero_window_t w;
+    dudero_ret_t wret = DUDERO_RET_TOO_SHORT;
+    FUZZ_ASSERT(dudero_window_init(&w, ring, wlen) == DUDERO_RET_OK);
+    for (size_t i=0; i<len; i++) {
+        wret = dudero_window_add(&w, buf[i]);
+    }
+    FUZZ_ASSERT(wret == (len < wlen ? DUDERO_RET_TOO_SHORT : dudero_check_buffer(buf + len - wlen, wlen)));
+
+    // snapshots survive the wire
+    dudero_snapshot_t snap, back;
+    uint8_t wire[DUDERO_SNAPSHOT_SIZE];
+    dudero_ctx_snapshot(&ref, &snap);
+    dudero_snapshot_serialize(&snap, wire);
+    FUZZ_ASSERT(dudero_snapshot_deserialize(&back, wire) == DUDERO_RET_OK);
+    FUZZ_ASSERT(memcmp(back.hist, ref.hist, sizeof ref.hist) == 0 && dudero_snapshot_evaluate(&back) == verdict);
+
+    FUZZ_ASSERT(dudero_check_buffer_mt(buf, len, 3) == verdict);
+    if (len == 32) {
+        FUZZ_ASSERT(check_32(buf) == verdict);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size < 2) {
+        check_input(data, 0, 0);
+        return 0;
+    }
+    const uint8_t *payload = data + 2;
+    size_t len = size - 2;
+    if ((data[0] & 0x80) && len > 0) {
+        for (size_t i=0; i<TILE_LEN; i++) {
+            tiled[i] = payload[i % len];
+        }
+        payload = tiled;
+        len = TILE_LEN;
+    }
+    check_input(payload, len, data[1]);
+    return 0;
+}
+
+// libFuzzer brings its own main
+#if !defined(DUDERO_LIBFUZZER)
+static int run_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    static uint8_t data[1 << 20];
+    size_t size = fread(data, 1, sizeof data, f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long iterations = 20000, seed = 1;
+    int files = 0;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i+1 < argc) {
+            iterations = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--iterations N] [--seed S] [FILE...]\n", argv[0]);
+            return 2;
+        } else {
+            if (run_file(argv[i]) != 0) {
+                return 2;
+            }
+            files++;
+        }
+    }
+    if (files) {
+        return 0;
+    }
+
+    static uint8_t data[2 + 4096];
+    prng_t prng;
+    prng_seed(&prng, seed);
+    for (unsigned long long it=0; it<iterations; it++) {
+        uint64_t r = prng_next(&prng);
+        // mostly short, the lengths with the most edges
+        size_t size = (r & 3) ? r % 80 : r % sizeof data;
+        prng_fill(&prng, data, size);
+        // random bytes pass; half the time, bias or flatten them so the
+        // failing paths get their share
+        const uint8_t mask = (uint8_t)(r >> 16), fill = (uint8_t)(r >> 24);
+        for (size_t i=2; i<size; i++) {
+            switch ((r >> 32) & 7) {
+            case 0: data[i] &= mask; break;
+            case 1: data[i] = fill; break;
+            case 2: data[i] = (uint8_t)(i * fill); break;
+            case 3: data[i] |= mask & 0x11; break;
+            default: break;
+            }
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%llu inputs OK\n", iterations);
+    return 0;
+}
+#endif // !DUDERO_LIBFUZZER
@@ -0,0 +1,52 @@
+#pragma once
+
+// xoshiro256** (Blackman & Vigna): small, fast, statistically solid
+// non-cryptographic PRNG for the tools. Deterministic given the seed, so
+// runs are reproducible; never use it as an entropy source.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t s[4];
+} prng_t;
+
+static inline uint64_t prng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t prng_next(prng_t *p) {
+    uint64_t *s = p->s;
+    const uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+    return result;
+}
+
+// seeds via splitmix64, as recommended by the xoshiro authors
+static inline void prng_seed(prng_t *p, uint64_t seed) {
+    for (int i=0; i<4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        p->s[i] = z ^ (z >> 31);
+    }
+}
+
+static inline void prng_fill(prng_t *p, uint8_t *buf, size_t len) {
+    size_t i = 0;
+    for (; i+8 <= len; i+=8) {
+        uint64_t r = prng_next(p);
+        memcpy(buf + i, &r, 8);
+    }
+    if (i < len) {
+        uint64_t r = prng_next(p);
+        memcpy(buf + i, &r, len - i);
+    }
+}
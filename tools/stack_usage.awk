@@ -0,0 +1,106 @@
+# Worst-case stack use of each public function, from the call graphs GCC
+# writes with -fcallgraph-info=su (one .ci file per translation unit).
+# Static functions are nodes titled "file.c:name", public ones just "name",
+# so calls across files resolve by name. Indirect calls are charged with
+# the deepest function matching the regex `indirect`.
+#
+# With -v ram=N (static .data + .bss) and -v budget=N, also fails if the
+# static RAM plus the deepest stack exceed the budget.
+#
+#   awk -f tools/stack_usage.awk -v indirect=hist_add -v ram=176 -v budget=1024 *.ci
+
+function quoted(key,    s) {
+    if (!match($0, key ": \"[^\"]*\"")) {
+        return ""
+    }
+    s = substr($0, RSTART + length(key) + 3, RLENGTH - length(key) - 4)
+    return s
+}
+
+function depth(f,    best, d, i, g) {
+    if (f in memo) {
+        return memo[f]
+    }
+    if (f in busy) {
+        unbounded[f] = 1
+        return 0
+    }
+    busy[f] = 1
+    best = 0
+    for (i = 1; i <= ncalls[f]; i++) {
+        d = depth(callee[f, i])
+        if (d > best) {
+            best = d
+        }
+    }
+    if (f == "__indirect_call") {
+        for (g in stack) {
+            if (g ~ indirect && (d = depth(g)) > best) {
+                best = d
+            }
+        }
+    }
+    delete busy[f]
+    memo[f] = stack[f] + best
+    return memo[f]
+}
+
+/^node:/ {
+    title = quoted("title")
+    label = quoted("label")
+    if (match(label, /[0-9]+ bytes \([a-z,]*\)/)) {
+        s = substr(label, RSTART, RLENGTH)
+        split(s, parts, " ")
+        stack[title] = parts[1] + 0
+        if (s !~ /\(static\)/ && s !~ /bounded/) {
+            unbounded[title] = 1
+        }
+    }
+}
+
+/^edge:/ {
+    from = quoted("sourcename")
+    callee[from, ++ncalls[from]] = quoted("targetname")
+}
+
+END {
+    worst = 0
+    n = 0
+    for (f in stack) {
+        if (f !~ /:/) {
+            names[++n] = f
+        }
+    }
+    # insertion sort, for a stable report
+    for (i = 2; i <= n; i++) {
+        for (j = i; j > 1 && names[j-1] > names[j]; j--) {
+            t = names[j]; names[j] = names[j-1]; names[j-1] = t
+        }
+    }
+    printf "%-32s %s\n", "function", "worst-case stack (bytes)"
+    for (i = 1; i <= n; i++) {
+        d = depth(names[i])
+        printf "%-32s %6d%s\n", names[i], d, (names[i] in unbounded) ? "  (unbounded!)" : ""
+        if (d > worst) {
+            worst = d
+        }
+    }
+    for (f in unbounded) {
+        bad = 1
+    }
+    if (ram != "") {
+        printf "static RAM %d + deepest stack %d = %d bytes", ram, worst, ram + worst
+        if (budget != "") {
+            printf " (budget %d)", budget
+        }
+        printf "\n"
+        if (budget != "" && ram + worst > budget + 0) {
+            print "over budget"
+            exit 1
+        }
+    }
+    if (bad) {
+        print "unbounded stack use (recursion or dynamic allocation)"
+        exit 1
+    }
+}